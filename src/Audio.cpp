@@ -0,0 +1,133 @@
+#include <algorithm>
+#include "Audio.hpp"
+#include "Chip8.hpp"
+
+#define TONE_HZ 440
+#define TONE_AMPLITUDE 3000
+#define MAX_RATE_DEVIATION 0.005 // 0.5%, too small to hear as a pitch change
+
+Beeper::Beeper()
+{
+    device = 0;
+    sampleRate = 0;
+    targetFrames = 0;
+    sampleRemainder = 0;
+    phase = 0;
+    stats = {0, 0, 1.0};
+}
+
+Beeper::~Beeper()
+{
+    close();
+}
+
+bool Beeper::open(int sampleRate, unsigned int targetFrames)
+{
+    close();
+    if(SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+    {
+        return false;
+    }
+
+    SDL_AudioSpec want{};
+    SDL_AudioSpec have{};
+    want.freq = sampleRate;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 512;
+    want.callback = NULL; // fed with SDL_QueueAudio
+
+    device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if(device == 0)
+    {
+        return false;
+    }
+
+    this->sampleRate = have.freq;
+    this->targetFrames = targetFrames;
+    sampleRemainder = 0;
+    phase = 0;
+    stats = {0, 0, 1.0};
+    SDL_PauseAudioDevice(device, 0);
+    return true;
+}
+
+void Beeper::close()
+{
+    if(device != 0)
+    {
+        SDL_CloseAudioDevice(device);
+        device = 0;
+    }
+}
+
+bool Beeper::isOpen() const
+{
+    return device != 0;
+}
+
+double Beeper::queuedFrames() const
+{
+    if(device == 0)
+    {
+        return 0;
+    }
+    double samplesPerFrame{(double)sampleRate / DRAWHZ};
+    return SDL_GetQueuedAudioSize(device) / sizeof(int16_t) / samplesPerFrame;
+}
+
+unsigned int Beeper::getTargetFrames() const
+{
+    return targetFrames;
+}
+
+const Beeper::Stats& Beeper::getStats() const
+{
+    return stats;
+}
+
+void Beeper::queueFrame(bool tone, bool rateControl)
+{
+    if(device == 0)
+    {
+        return;
+    }
+
+    // start, or restart after a stall, from a queue primed with silence so
+    // rate control has slack to work with instead of crackling up from empty
+    double queued{queuedFrames()};
+    if(queued == 0)
+    {
+        if(stats.frames > 0)
+        {
+            stats.underruns++;
+        }
+        samples.assign((size_t)sampleRate * targetFrames / DRAWHZ, 0);
+        SDL_QueueAudio(device, samples.data(), samples.size() * sizeof(int16_t));
+        queued = targetFrames;
+    }
+
+    // more samples when the queue is below target, fewer when above
+    double ratio{1.0};
+    if(rateControl)
+    {
+        double error{(targetFrames - queued) / targetFrames};
+        ratio = 1.0 + std::clamp(error, -1.0, 1.0) * MAX_RATE_DEVIATION;
+    }
+    stats.rateRatio = ratio;
+
+    sampleRemainder += (double)sampleRate / DRAWHZ * ratio;
+    size_t count = (size_t)sampleRemainder;
+    sampleRemainder -= count;
+
+    samples.resize(count);
+    uint32_t halfPeriod = sampleRate / (TONE_HZ * 2);
+    for(size_t i{0}; i < count; i++)
+    {
+        // keep the wave running through silence so the tone starts clean
+        samples[i] = tone ? ((phase / halfPeriod) & 0x1 ? -TONE_AMPLITUDE : TONE_AMPLITUDE) : 0;
+        phase = (phase + 1) % (halfPeriod * 2);
+    }
+    SDL_QueueAudio(device, samples.data(), count * sizeof(int16_t));
+    stats.frames++;
+}
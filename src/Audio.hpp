@@ -0,0 +1,53 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <SDL.h>
+#include <cstdint>
+#include <vector>
+
+/*
+Beeper plays the CHIP-8 sound timer as a square wave through an SDL audio
+queue. One emulated frame queues one frame's worth of samples, so the
+amount still queued doubles as a clock
+    Audio master: emulate whenever the queue drops below target
+    VSync: the display sets the pace and dynamic rate control stretches or
+    squeezes each frame's samples (at most MAX_RATE_DEVIATION) to hold the
+    queue at target, absorbing e.g. a 59.94 Hz display without crackles
+*/
+class Beeper
+{
+    public:
+        struct Stats
+        {
+            uint64_t frames;      // emulated frames queued
+            uint64_t underruns;   // queue ran dry
+            double rateRatio;     // last dynamic rate control ratio
+        };
+
+        Beeper();
+        ~Beeper();
+
+        bool open(int sampleRate = 48000, unsigned int targetFrames = 4);
+        void close();
+        bool isOpen() const;
+
+        // Queues one emulated frame of tone or silence
+        void queueFrame(bool tone, bool rateControl);
+
+        double queuedFrames() const;
+        unsigned int getTargetFrames() const;
+        const Stats& getStats() const;
+
+    private:
+        SDL_AudioDeviceID device;
+        int sampleRate;
+        unsigned int targetFrames;
+
+        double sampleRemainder; // fractional samples carried between frames
+        uint32_t phase;         // square wave position in samples
+        std::vector<int16_t> samples;
+
+        Stats stats;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include <chrono>
+#include <fstream>
+#include <map>
+#include "Batch.hpp"
+#include "Scheduler.hpp"
+
+#define DEFAULT_FRAMES 600 // same as chip8-headless
+
+BatchRunner::BatchRunner(unsigned int threads) : pool(threads), slots(pool.size())
+{
+    engine = Chip8::Engine::Interpreter;
+    skipIdle = true;
+}
+
+unsigned int BatchRunner::threads() const
+{
+    return pool.size();
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchTask>& tasks)
+{
+    // read every file once, tasks share them read only
+    std::map<std::string, std::vector<uint8_t>> roms;
+    std::map<std::string, InputLog> scripts;
+    for(const BatchTask& task : tasks)
+    {
+        if(roms.count(task.rom) == 0)
+        {
+            std::ifstream file(task.rom, std::ios::binary);
+            std::vector<uint8_t>& bytes{roms[task.rom]};
+            if(file.is_open())
+            {
+                // more than fits in RAM, so a file too big still reads as too big
+                bytes.resize(RAM_SIZE);
+                file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+                bytes.resize(file.bad() ? 0 : file.gcount());
+            }
+        }
+        if(!task.inputScript.empty() && scripts.count(task.inputScript) == 0)
+        {
+            if(!scripts[task.inputScript].load(task.inputScript))
+            {
+                scripts.erase(task.inputScript);
+            }
+        }
+    }
+
+    std::vector<BatchResult> results(tasks.size());
+    pool.run(tasks.size(), [&](size_t index, unsigned int worker)
+    {
+        const BatchTask& task{tasks[index]};
+        BatchResult& result{results[index]};
+        result = {false, "", 0, 0, 0, 0, 0};
+
+        const std::vector<uint8_t>& rom{roms.at(task.rom)};
+        if(rom.empty())
+        {
+            result.error = "could not read " + task.rom;
+            return;
+        }
+
+        // the replay cursor is per run, the records are copied once per task
+        InputLog script;
+        if(!task.inputScript.empty())
+        {
+            auto found = scripts.find(task.inputScript);
+            if(found == scripts.end())
+            {
+                result.error = "could not read " + task.inputScript;
+                return;
+            }
+            script = found->second;
+        }
+
+        // first touch from the worker's own thread
+        Slot& slot{slots[worker]};
+        if(!slot.instance)
+        {
+            slot.instance.reset(new Instance);
+        }
+        Chip8& chip{slot.instance->chip};
+        chip.reset();
+        chip.engine = engine;
+        chip.skipIdle = skipIdle;
+        if(!chip.loadROM(rom.data(), rom.size()))
+        {
+            result.error = task.rom + " will not fit";
+            return;
+        }
+
+        Scheduler scheduler(chip);
+        scheduler.setMode(Scheduler::Mode::FixedStep);
+        uint64_t frames{task.frames};
+        if(task.inputScript.empty())
+        {
+            chip.seedRandom(task.seed);
+        }
+        else
+        {
+            chip.seedRandom(script.seed);
+            scheduler.setReplay(&script);
+            if(frames == 0)
+            {
+                frames = (script.endCycle * DRAWHZ + CLOCKHZ - 1) / CLOCKHZ;
+            }
+        }
+        if(frames == 0)
+        {
+            frames = DEFAULT_FRAMES;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        while(scheduler.getFrames() < frames)
+        {
+            scheduler.runFrame();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        result.ok = true;
+        result.stateHash = chip.stateHash();
+        result.frames = scheduler.getFrames();
+        result.cycles = scheduler.getCycles();
+        result.idleCycles = chip.idleCycles;
+        result.seconds = elapsed.count();
+    });
+
+    return results;
+}
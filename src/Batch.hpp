@@ -0,0 +1,68 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include "Chip8.hpp"
+#include "InputLog.hpp"
+#include "WorkPool.hpp"
+
+// One headless run: a ROM, optionally fed keys from an InputLog file
+struct BatchTask
+{
+    std::string rom;
+    std::string inputScript; // recorded with Chip8 --record, empty for no input
+    uint64_t frames;         // 0 runs to the end of the input script, or 600 frames
+    uint32_t seed;           // CXNN seed when there is no input script to take it from
+};
+
+struct BatchResult
+{
+    bool ok;
+    std::string error;
+    uint64_t stateHash; // Chip8::stateHash() after the last frame
+    uint64_t frames;
+    uint64_t cycles;
+    uint64_t idleCycles;
+    double seconds;
+};
+
+/*
+BatchRunner runs many independent tasks on a WorkPool
+Every task gets a freshly reset Chip8 and a FixedStep Scheduler, so its
+result is the same as chip8-headless would give for it, whatever the
+thread count or order. ROMs and input scripts are read once up front and
+shared read only. Each worker reuses one Chip8 of its own, allocated by
+that worker's thread and padded to whole cache lines, so instances never
+share a line and stay in memory local to the core using them.
+*/
+class BatchRunner
+{
+    public:
+        Chip8::Engine engine;
+        bool skipIdle;
+
+        BatchRunner(unsigned int threads = 0); // 0 for one per hardware thread
+
+        std::vector<BatchResult> run(const std::vector<BatchTask>& tasks);
+        unsigned int threads() const;
+
+    private:
+        // starts and ends on a cache line boundary
+        struct alignas(64) Instance
+        {
+            Chip8 chip;
+        };
+
+        struct alignas(64) Slot
+        {
+            std::unique_ptr<Instance> instance;
+        };
+
+        WorkPool pool;
+        std::vector<Slot> slots; // one per worker
+};
+
+#endif
@@ -1,19 +1,38 @@
+#include <chrono>
 #include "Chip8.hpp"
 
+#define STATE_MAGIC "C8ST"
+
+// FNV-1a, for state hashes and save file checksums
+static uint64_t fnv1a(const void* data, size_t size)
+{
+    uint64_t hash{0xCBF29CE484222325};
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for(size_t i{0}; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+    }
+    return hash;
+}
+
 Chip8::Chip8()
 {
+    engine = Engine::Interpreter;
+    skipIdle = true;
+    chargeKeyWait = true;
+    reset();
+}
+
+void Chip8::reset()
+{
+    // everything not set below starts cleared
+    memset(static_cast<Chip8State*>(this), 0, sizeof(Chip8State));
+
     // Random number generator
-    std::srand(std::time(nullptr));
-    randomGen.seed(std::chrono::system_clock::now().time_since_epoch().count());
-    randomNum = std::uniform_int_distribution<>(0,255);
+    seedRandom(std::chrono::system_clock::now().time_since_epoch().count());
     // Initialize program counter to start value
     // 0x0 to 0x1FF is reserved
     pc = RAM_START;
-    soundTimer = 0;
-    delayTimer = 0;
-    indexReg = 0;
-    sp = 0;
-    keyHold = 16;
 
     // Font typically stored between 0x050 to 0x09F
     // A character is represented using 4x5 binary
@@ -43,42 +62,183 @@ Chip8::Chip8()
         ram[0x50 + i] = fonts[i];
     }
 
-    // init arrays
-    memset(display, 0, DISPLAY_SIZE);
-    memset(keypad, 0, 16);
-    memset(registers, 0, 16);
-    memset(stack, 0, 16);
+    displayDirty = false;
+    markDirty(0, DISPLAY_ROWS - 1);
 
+    verifyMismatches = 0;
+    verifyMismatchPc = 0;
+    clearTrap();
+    syncEvents = 0;
+    memset(blockLength, 0, RAM_SIZE);
+    memset(codeMap, 0, RAM_SIZE);
+    blocksStale = false;
+    staticModified = false;
+    idleCycles = 0;
+    idleProbe.jump = RAM_SIZE; // none
+    idleEdge = RAM_SIZE;
+    idleBodyJump = RAM_SIZE;
+    idleBodyPure = false;
+    invalidate(0, RAM_SIZE);
 
 }
 
-void Chip8::loadROM(const std::string fileName)
+bool Chip8::loadROM(const uint8_t* data, size_t size)
 {
-    std::ifstream inputFile(fileName, std::ios::binary); 
-    if(inputFile.is_open())
+    if(size > (RAM_SIZE - RAM_START))
     {
-        uintmax_t fileSize{std::filesystem::file_size(fileName)};
-        if(fileSize > (RAM_SIZE - RAM_START))
-        {
-            std::cout << "File will not fit";
-            return;
-        }
-        char* fBuffer{new char[fileSize]};
-        inputFile.read(fBuffer, fileSize);
+        return false;
+    }
+    memcpy(ram + RAM_START, data, size);
+    invalidate(RAM_START, size);
+    return true;
+}
+
+void Chip8::packDisplay(uint8_t* out) const
+{
+    // byte order independent, the stores merge into one byte swap per row
+    for(unsigned int row{0}; row < DISPLAY_ROWS; row++)
+    {
+        uint64_t pixels{display[row]};
+        uint8_t* bytes{out + row * 8};
+        bytes[0] = pixels >> 56;
+        bytes[1] = pixels >> 48;
+        bytes[2] = pixels >> 40;
+        bytes[3] = pixels >> 32;
+        bytes[4] = pixels >> 24;
+        bytes[5] = pixels >> 16;
+        bytes[6] = pixels >> 8;
+        bytes[7] = pixels;
+    }
+}
 
-        inputFile.close();
-        for(uintmax_t i{0}; i < fileSize; i++)
+void Chip8::clearDirty()
+{
+    displayDirty = false;
+}
+
+void Chip8::markDirty(uint8_t firstRow, uint8_t lastRow)
+{
+    if(!displayDirty)
+    {
+        dirtyTop = firstRow;
+        dirtyBottom = lastRow;
+        displayDirty = true;
+        return;
+    }
+    dirtyTop = std::min(dirtyTop, firstRow);
+    dirtyBottom = std::max(dirtyBottom, lastRow);
+}
+
+void Chip8::seedRandom(uint32_t seed)
+{
+    // spread small seeds out, the odd constant keeps 0 from sticking
+    randomState = (seed * 0x9E3779B9) | 0x1;
+}
+
+uint8_t Chip8::nextRandom()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState >> 24;
+}
+
+const Chip8State& Chip8::state() const
+{
+    return *this;
+}
+
+void Chip8::saveState(Chip8State& out) const
+{
+    memcpy(&out, &state(), sizeof(Chip8State));
+}
+
+void Chip8::loadState(const Chip8State& in)
+{
+    // decoded instructions and blocks only go stale where ram differs
+    for(uint16_t addr{0}; addr < RAM_SIZE; addr += 64)
+    {
+        if(memcmp(ram + addr, in.ram + addr, 64) != 0)
         {
-            ram[RAM_START + i] = fBuffer[i]; 
+            invalidate(addr, 64);
         }
+    }
+    if(memcmp(display, in.display, sizeof(display)) != 0)
+    {
+        markDirty(0, DISPLAY_ROWS - 1);
+    }
+
+    memcpy(static_cast<Chip8State*>(this), &in, sizeof(Chip8State));
+    idleProbe.jump = RAM_SIZE;
+    clearTrap();
+}
 
-        delete[] fBuffer;
+size_t Chip8::saveState(uint8_t* out, size_t size) const
+{
+    if(size < STATE_FILE_SIZE)
+    {
+        return 0;
     }
-    else
+    uint32_t version{STATE_VERSION};
+    uint32_t stateSize{sizeof(Chip8State)};
+    uint64_t checksum{fnv1a(&state(), sizeof(Chip8State))};
+    memcpy(out, STATE_MAGIC, 4);
+    memcpy(out + 4, &version, 4);
+    memcpy(out + 8, &stateSize, 4);
+    memcpy(out + 12, &checksum, 8);
+    memcpy(out + STATE_HEADER, &state(), sizeof(Chip8State));
+    return STATE_FILE_SIZE;
+}
+
+bool Chip8::loadState(const uint8_t* in, size_t size)
+{
+    if(size < STATE_FILE_SIZE)
     {
-        std::cout << "Could not open file";
+        return false;
+    }
+    Chip8State loaded;
+    memcpy(&loaded, in + STATE_HEADER, sizeof(Chip8State));
+
+    // the state is stored as it sits in memory, so its layout has to match
+    uint32_t version;
+    uint32_t stateSize;
+    uint64_t checksum;
+    memcpy(&version, in + 4, 4);
+    memcpy(&stateSize, in + 8, 4);
+    memcpy(&checksum, in + 12, 8);
+    if(memcmp(in, STATE_MAGIC, 4) != 0 || version != STATE_VERSION || stateSize != sizeof(Chip8State)
+        || checksum != fnv1a(&loaded, sizeof(Chip8State)))
+    {
+        return false;
+    }
+
+    loadState(loaded);
+    return true;
+}
+
+void Chip8::setKey(uint8_t key, bool pressed)
+{
+    uint16_t bit = 1 << (key & 0xF);
+    keypad = pressed ? keypad | bit : keypad & ~bit;
+
+    // any press lets FX0A run again, only its own key's release ends the hold
+    if((keyWait == KEY_WAIT_PRESS && pressed)
+        || (keyWait == KEY_WAIT_RELEASE && !pressed && (key & 0xF) == keyWaitKey))
+    {
+        keyWait = KEY_WAIT_NONE;
+    }
+}
+
+void Chip8::setKeys(uint16_t mask)
+{
+    uint16_t changed = keypad ^ mask;
+    for(uint8_t key{0}; key < 16; key++)
+    {
+        if(changed & (1 << key))
+        {
+            setKey(key, mask & (1 << key));
+        }
     }
-    
 }
 
 void Chip8::tickTimers()
@@ -93,182 +253,770 @@ void Chip8::tickTimers()
     }
 }
 
+// FNV-1a over all machine state, for comparing runs
+uint64_t Chip8::stateHash() const
+{
+    return hashState(state());
+}
+
+uint64_t Chip8::hashState(const Chip8State& state)
+{
+    return fnv1a(&state, sizeof(Chip8State));
+}
+
 void Chip8::run()
 {
+    // Fetch, key waits are handled by runCycles()
+    if(STRICT_MEMORY && trapFetch())
+    {
+        return;
+    }
+    DecodedOp& inst = decoded[pc & (RAM_SIZE - 1)];
+    if(inst.handler == OP_UNDECODED)
+    {
+        decodeAt(pc & (RAM_SIZE - 1));
+    }
+    execute(inst);
+}
+
+void Chip8::execute(const DecodedOp& inst)
+{
+    pc += 2;
+
+    // Decode (already done by the cache)
+    opcode = inst.opcode;
+    Vx = inst.Vx;
+    Vy = inst.Vy;
+    N = inst.N;
+    NN = inst.NN;
+    NNN = inst.NNN;
+
+    // Execute
+    opHandlers[inst.handler](*this);
+}
 
+// run() as it was before the opcode table and the decode cache, for
+// measuring them against
+void Chip8::runSwitch()
+{
     // Fetch
-    if(keyHold == 16)
+    if(STRICT_MEMORY && trapFetch())
     {
-        opcode = (ram[pc] << 8) | (ram[pc + 1]);
-        pc += 2;
+        return;
+    }
+    opcode = (ram[pc & (RAM_SIZE - 1)] << 8) | ram[(pc + 1) & (RAM_SIZE - 1)];
+    pc += 2;
 
-        // Decode
-        Vx = (opcode & 0x0F00) >> 8;
-        Vy = (opcode & 0x00F0) >> 4;
-        N = (opcode & 0x000F);
-        NN = (opcode & 0x00FF);
-        NNN = (opcode & 0x0FFF);
+    // Decode
+    Vx = (opcode & 0x0F00) >> 8;
+    Vy = (opcode & 0x00F0) >> 4;
+    N = (opcode & 0x000F);
+    NN = (opcode & 0x00FF);
+    NNN = (opcode & 0x0FFF);
 
-        // Execute
-        switch((opcode & 0xF000) >> 12)
+    // Execute, undefined opcodes do nothing like opTrap()
+    switch((opcode & 0xF000) >> 12)
+    {
+        case 0x0:
+            switch(NNN)
+            {
+                case 0x0E0:
+                    op00E0();
+                    break;
+                case 0x0EE:
+                    op00EE();
+                    break;
+            }
+            break;
+        case 0x1:
+            op1NNN();
+            break;
+        case 0x2:
+            op2NNN();
+            break;
+        case 0x3:
+            op3XNN();
+            break;
+        case 0x4:
+            op4XNN();
+            break;
+        case 0x5:
+            op5XY0();
+            break;
+        case 0x6:
+            op6XNN();
+            break;
+        case 0x7:
+            op7XNN();
+            break;
+        case 0x8:
+            switch(N)
+            {
+                case 0x0:
+                    op8XY0();
+                    break;
+                case 0x1:
+                    op8XY1();
+                    break;
+                case 0x2:
+                    op8XY2();
+                    break;
+                case 0x3:
+                    op8XY3();
+                    break;
+                case 0x4:
+                    op8XY4();
+                    break;
+                case 0x5:
+                    op8XY5();
+                    break;
+                case 0x6:
+                    op8XY6();
+                    break;
+                case 0x7:
+                    op8XY7();
+                    break;
+                case 0xE:
+                    op8XYE();
+                    break;
+            }
+            break;
+        case 0x9:
+            op9XY0();
+            break;
+        case 0xA:
+            opANNN();
+            break;
+        case 0xB:
+            opBNNN();
+            break;
+        case 0xC:
+            opCXNN();
+            break;
+        case 0xD:
+            opDXYN();
+            break;
+        case 0xE:
+            switch(NN)
+            {
+                case 0x9E:
+                    opEX9E();
+                    break;
+                case 0xA1:
+                    opEXA1();
+                    break;
+            }
+            break;
+        case 0xF:
+            switch(NN)
+            {
+                case 0x07:
+                    opFX07();
+                    break;
+                case 0x0A:
+                    opFX0A();
+                    break;
+                case 0x15:
+                    opFX15();
+                    break;
+                case 0x18:
+                    opFX18();
+                    break;
+                case 0x1E:
+                    opFX1E();
+                    break;
+                case 0x29:
+                    opFX29();
+                    break;
+                case 0x33:
+                    opFX33();
+                    break;
+                case 0x55:
+                    opFX55();
+                    break;
+                case 0x65:
+                    opFX65();
+                    break;
+            }
+            break;
+    }
+}
+
+unsigned int Chip8::runCycles(unsigned int budget)
+{
+    unsigned int cycles{0};
+    syncEvents = 0;
+    idleProbe.jump = RAM_SIZE; // timers and keys may have changed since
+
+    if(STRICT_MEMORY && trapped())
+    {
+        syncEvents |= SYNC_TRAP;
+        return 0;
+    }
+
+    // still blocked in FX0A, no key edge has come in
+    if(keyWait != KEY_WAIT_NONE)
+    {
+        syncEvents |= SYNC_KEY_WAIT;
+        return chargeKeyWait ? budget : 0;
+    }
+
+    while(true)
+    {
+        switch(engine)
         {
-            case 0x0:
-                switch(NNN)
+            case Engine::Interpreter:
+                while(cycles < budget && !syncEvents)
                 {
-                    case 0x0E0:
-                        op00E0();
-                        break;
-                    case 0x0EE:
-                        op00EE();
-                        break;
-                    // unimplemented: op0NNN();
+                    run();
+                    cycles++;
                 }
                 break;
-            case 0x1: // only one instr.
-                op1NNN();
-                break;
-            case 0x2: // only one instr.
-                op2NNN();
-                break;
-            case 0x3: // only one instr.
-                op3XNN();
-                break;
-            case 0x4: // only one instr.
-                op4XNN();
-                break;
-            case 0x5: // only one instr.
-                op5XY0();
-                break;
-            case 0x6: // only one instr.
-                op6XNN();
-                break;
-            case 0x7: // only one instr.
-                op7XNN();
-                break;
-            case 0x8:
-                switch(N)
+            case Engine::Blocks:
+                while(cycles < budget && !syncEvents)
                 {
-                    case 0x0:
-                        op8XY0();
-                        break;
-                    case 0x1:
-                        op8XY1();
-                        break;
-                    case 0x2:
-                        op8XY2();
-                        break;
-                    case 0x3:
-                        op8XY3();
-                        break;
-                    case 0x4:
-                        op8XY4();
-                        break;
-                    case 0x5:
-                        op8XY5();
-                        break;
-                    case 0x6:
-                        op8XY6();
-                        break;
-                    case 0x7:
-                        op8XY7();
-                        break;
-                    case 0xE:
-                        op8XYE();
-                        break;
+                    cycles += runBlock(budget - cycles);
                 }
                 break;
-            case 0x9: // only one instr.
-                op9XY0();
-                break;
-            case 0xA: // only one instr.
-                opANNN();
-                break;
-            case 0xB: // only one instr.
-                opBNNN();
-                break;
-            case 0xC: // only one instr.
-                opCXNN();
-                break;
-            case 0xD: // only one instr.
-                opDXYN();
-                break;
-            case 0xE:
-                switch(NN)
+            case Engine::Verify:
+                while(cycles < budget && !syncEvents)
                 {
-                    case 0xA1:
-                        opEXA1();
-                        break;
-                    case 0x9E:
-                        opEX9E();
-
+                    cycles += verifyBlock(budget - cycles);
                 }
                 break;
-            case 0xF:
-                switch(NN)
+            case Engine::Switch:
+                while(cycles < budget && !syncEvents)
                 {
-                    case 0x07:
-                        opFX07();
-                        break;
-                    case 0x0A:
-                        opFX0A();
-                        break;
-                    case 0x15:
-                        opFX15();
-                        break;
-                    case 0x18:
-                        opFX18();
-                        break;
-                    case 0x1E:
-                        opFX1E();
-                        break;
-                    case 0x29:
-                        opFX29();
-                        break;
-                    case 0x33:
-                        opFX33();
-                        break;
-                    case 0x55:
-                        opFX55();
-                        break;
-                    case 0x65:
-                        opFX65();
-                        break;
+                    runSwitch();
+                    cycles++;
                 }
                 break;
+        }
+
+        // a backward jump is not a reason to return, check it and go on
+        if(!(syncEvents & SYNC_IDLE))
+        {
+            break;
+        }
+        syncEvents &= ~SYNC_IDLE;
+        if(skipIdle)
+        {
+            cycles += fastForwardIdle(cycles, budget - cycles);
+        }
+    }
+
+    // FX0A blocked partway through the budget
+    if(keyWait != KEY_WAIT_NONE && chargeKeyWait)
+    {
+        cycles = budget;
+    }
+    return cycles;
+}
 
+unsigned int Chip8::runFrame(unsigned int& cycleRemainder, unsigned int& timerRemainder)
+{
+    cycleRemainder += CLOCKHZ;
+    unsigned int frameCycles{cycleRemainder / DRAWHZ};
+    cycleRemainder %= DRAWHZ;
+
+    unsigned int executed{0};
+    while(executed < frameCycles)
+    {
+        executed += runCycles(frameCycles - executed);
+
+        // nothing changes until the next input poll, or at all after a trap
+        if(syncEvents & (SYNC_KEY_WAIT | SYNC_TRAP))
+        {
+            break;
         }
     }
-    else // check to remove keyHold so we can continue
+
+    timerRemainder += DELAYHZ;
+    for(unsigned int tick{0}; tick < timerRemainder / DRAWHZ; tick++)
+    {
+        tickTimers();
+    }
+    timerRemainder %= DRAWHZ;
+    return executed;
+}
+
+// Instructions that only read memory, timers and keys and only write
+// registers, so a loop made of them is a pure function of its state
+bool Chip8::idleBody(uint16_t jump)
+{
+    if(jump == idleBodyJump)
     {
-        if(!keypad[keyHold])
+        return idleBodyPure;
+    }
+    idleBodyJump = jump;
+    idleBodyPure = true;
+
+    // a jump back by an odd distance, or from past the end of RAM, never
+    // lands on the jump again, so give up after the longest loop body
+    uint16_t addr = pc & (RAM_SIZE - 1);
+    for(unsigned int length{0}; addr != jump; length++, addr = (addr + 2) & (RAM_SIZE - 1))
+    {
+        if(length == MAX_IDLE_LENGTH)
+        {
+            idleBodyPure = false;
+            return false;
+        }
+        if(decoded[addr].handler == OP_UNDECODED)
+        {
+            decodeAt(addr);
+        }
+        switch(decoded[addr].handler)
         {
-            keyHold = 16;
+            case OP_3XNN: case OP_4XNN: case OP_5XY0: case OP_9XY0:
+            case OP_6XNN: case OP_7XNN:
+            case OP_8XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3: case OP_8XY4:
+            case OP_8XY5: case OP_8XY6: case OP_8XY7: case OP_8XYE:
+            case OP_ANNN: case OP_EX9E: case OP_EXA1:
+            case OP_FX07: case OP_FX1E: case OP_FX29: case OP_FX65:
+                break;
+            default:
+                idleBodyPure = false;
+                return false;
         }
     }
+    return true;
+}
+
+// Called right after the jump at idleEdge went back to pc, cycle is where
+// runCycles() is in its budget. Returns the cycles skipped.
+// A lap may leave the body through a skip and come back to the same jump,
+// so the instructions that change more than registers and I (calls,
+// returns, stores, CXNN, FX15) drop the probe whenever they run, and a
+// repeated lap has only ever run pure instructions.
+unsigned int Chip8::fastForwardIdle(unsigned int cycle, unsigned int left)
+{
+    if(!idleBody(idleEdge))
+    {
+        return 0;
+    }
+
+    // one more lap that ended in the same state, every later lap within
+    // this runCycles() call will too
+    bool repeated{idleProbe.jump == idleEdge
+        && idleProbe.indexReg == indexReg
+        && memcmp(idleProbe.registers, registers, 16) == 0};
+    if(!repeated)
+    {
+        idleProbe.jump = idleEdge;
+        idleProbe.cycle = cycle;
+        idleProbe.indexReg = indexReg;
+        memcpy(idleProbe.registers, registers, 16);
+        return 0;
+    }
+
+    unsigned int lap{cycle - idleProbe.cycle};
+    unsigned int skipped{left / lap * lap};
+    idleProbe.cycle = cycle + skipped;
+    idleCycles += skipped;
+    return skipped;
+}
+
+void Chip8::runOpcode(uint16_t op)
+{
+    DecodedOp inst;
+    inst.opcode = op;
+    inst.Vx = (op & 0x0F00) >> 8;
+    inst.Vy = (op & 0x00F0) >> 4;
+    inst.N = (op & 0x000F);
+    inst.NN = (op & 0x00FF);
+    inst.NNN = (op & 0x0FFF);
+    inst.handler = opTable[op];
+    execute(inst);
+}
+
+void Chip8::markStaticCode(uint16_t addr, uint16_t length)
+{
+    for(uint16_t i{0}; i < length; i++)
+    {
+        codeMap[(addr + i) & (RAM_SIZE - 1)] |= CODE_STATIC;
+    }
+}
+
+bool Chip8::staticCodeModified() const
+{
+    return staticModified;
+}
+
+bool Chip8::waitingForKey() const
+{
+    return keyWait != KEY_WAIT_NONE;
+}
+
+bool Chip8::trapped() const
+{
+    return trap.kind != TrapKind::None;
+}
+
+const Chip8::Trap& Chip8::getTrap() const
+{
+    return trap;
+}
+
+void Chip8::clearTrap()
+{
+    trap = {TrapKind::None, 0, 0, 0};
+}
+
+const char* Chip8::trapName(TrapKind kind)
+{
+    switch(kind)
+    {
+        case TrapKind::None: return "none";
+        case TrapKind::StackOverflow: return "stack overflow";
+        case TrapKind::StackUnderflow: return "stack underflow";
+        case TrapKind::MemoryRange: return "memory out of range";
+        case TrapKind::PcRange: return "pc out of range";
+    }
+    return "unknown";
+}
+
+bool Chip8::trapFetch()
+{
+    // both opcode bytes have to be in RAM
+    if(pc <= RAM_SIZE - 2)
+    {
+        return false;
+    }
+    trap = {TrapKind::PcRange, pc, 0, pc};
+    syncEvents |= SYNC_TRAP;
+    return true;
+}
+
+bool Chip8::trapRange(uint16_t addr, unsigned int length)
+{
+    if(length == 0 || addr + length <= RAM_SIZE)
+    {
+        return false;
+    }
+    raiseTrap(TrapKind::MemoryRange, std::max<unsigned int>(addr, RAM_SIZE));
+    return true;
+}
+
+void Chip8::raiseTrap(TrapKind kind, uint16_t address)
+{
+    // execute() already moved past the instruction, point back at it
+    pc -= 2;
+    trap = {kind, pc, opcode, address};
+    syncEvents |= SYNC_TRAP;
+}
+
+bool Chip8::endsBlock(uint8_t handler)
+{
+    // anything that can change control flow, draws or waits on input
+    switch(handler)
+    {
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_BNNN:
+        case OP_DXYN:
+        case OP_EX9E:
+        case OP_EXA1:
+        case OP_FX0A:
+            return true;
+    }
+    return false;
+}
+
+void Chip8::buildBlock(uint16_t addr)
+{
+    uint8_t length{0};
+    uint16_t cur{addr};
+    while(length < MAX_BLOCK_LENGTH)
+    {
+        if(decoded[cur].handler == OP_UNDECODED)
+        {
+            decodeAt(cur);
+        }
+        codeMap[cur] |= CODE_BLOCK;
+        codeMap[(cur + 1) & (RAM_SIZE - 1)] |= CODE_BLOCK;
+        length++;
+
+        if(endsBlock(decoded[cur].handler))
+        {
+            break;
+        }
+        // strict blocks stop at the end of RAM so the fetch past it traps
+        if(STRICT_MEMORY && cur + 2 > RAM_SIZE - 2)
+        {
+            break;
+        }
+        cur = (cur + 2) & (RAM_SIZE - 1);
+    }
+    blockLength[addr] = length;
+}
+
+unsigned int Chip8::runBlock(unsigned int budget)
+{
+    if(blocksStale)
+    {
+        memset(blockLength, 0, RAM_SIZE);
+        for(uint16_t i{0}; i < RAM_SIZE; i++)
+        {
+            codeMap[i] &= ~CODE_BLOCK;
+        }
+        blocksStale = false;
+    }
+
+    // counted as a cycle, like run() counts it
+    if(STRICT_MEMORY && trapFetch())
+    {
+        return 1;
+    }
+
+    uint16_t start = pc & (RAM_SIZE - 1);
+    if(!blockLength[start])
+    {
+        buildBlock(start);
+    }
+
+    unsigned int count{blockLength[start]};
+    if(count > budget)
+    {
+        count = budget;
+    }
+    for(unsigned int i{0}; i < count; i++)
+    {
+        execute(decoded[(start + 2*i) & (RAM_SIZE - 1)]);
+
+        // self-modifying code, the rest of this block may be stale
+        if(blocksStale || syncEvents)
+        {
+            return i + 1;
+        }
+    }
+    return count;
+}
+
+unsigned int Chip8::verifyBlock(unsigned int budget)
+{
+    // copy includes the RNG so CXNN produces the same values on both sides
+    Chip8 reference{*this};
+
+    unsigned int count{runBlock(budget)};
+    for(unsigned int i{0}; i < count; i++)
+    {
+        reference.run();
+    }
+
+    if(!sameState(reference))
+    {
+        verifyMismatches++;
+        verifyMismatchPc = pc;
+
+        // carry on from the interpreter's state
+        unsigned int mismatches{verifyMismatches};
+        uint16_t mismatchPc{verifyMismatchPc};
+        *this = reference;
+        verifyMismatches = mismatches;
+        verifyMismatchPc = mismatchPc;
+    }
+    return count;
+}
+
+bool Chip8::sameState(const Chip8& other) const
+{
+    return memcmp(&state(), &other.state(), sizeof(Chip8State)) == 0;
+}
+
+const OpHandler Chip8::opHandlers[OP_COUNT] =
+{
+    opThunk<&Chip8::opTrap>,
+    opThunk<&Chip8::op00E0>, opThunk<&Chip8::op00EE>, opThunk<&Chip8::op1NNN>,
+    opThunk<&Chip8::op2NNN>, opThunk<&Chip8::op3XNN>, opThunk<&Chip8::op4XNN>,
+    opThunk<&Chip8::op5XY0>, opThunk<&Chip8::op6XNN>, opThunk<&Chip8::op7XNN>,
+    opThunk<&Chip8::op8XY0>, opThunk<&Chip8::op8XY1>, opThunk<&Chip8::op8XY2>,
+    opThunk<&Chip8::op8XY3>, opThunk<&Chip8::op8XY4>, opThunk<&Chip8::op8XY5>,
+    opThunk<&Chip8::op8XY6>, opThunk<&Chip8::op8XY7>, opThunk<&Chip8::op8XYE>,
+    opThunk<&Chip8::op9XY0>, opThunk<&Chip8::opANNN>, opThunk<&Chip8::opBNNN>,
+    opThunk<&Chip8::opCXNN>, opThunk<&Chip8::opDXYN>, opThunk<&Chip8::opEX9E>,
+    opThunk<&Chip8::opEXA1>, opThunk<&Chip8::opFX07>, opThunk<&Chip8::opFX0A>,
+    opThunk<&Chip8::opFX15>, opThunk<&Chip8::opFX18>, opThunk<&Chip8::opFX1E>,
+    opThunk<&Chip8::opFX29>, opThunk<&Chip8::opFX33>, opThunk<&Chip8::opFX55>,
+    opThunk<&Chip8::opFX65>
+};
+
+uint8_t Chip8::opTable[0x10000];
+const bool Chip8::opTableReady = Chip8::buildOpTable();
+
+uint8_t Chip8::decodeOp(uint16_t op)
+{
+    switch((op & 0xF000) >> 12)
+    {
+        case 0x0:
+            switch(op & 0x0FFF)
+            {
+                case 0x0E0: return OP_00E0;
+                case 0x0EE: return OP_00EE;
+                // unimplemented: op0NNN();
+            }
+            break;
+        case 0x1: return OP_1NNN;
+        case 0x2: return OP_2NNN;
+        case 0x3: return OP_3XNN;
+        case 0x4: return OP_4XNN;
+        case 0x5: return OP_5XY0;
+        case 0x6: return OP_6XNN;
+        case 0x7: return OP_7XNN;
+        case 0x8:
+            switch(op & 0x000F)
+            {
+                case 0x0: return OP_8XY0;
+                case 0x1: return OP_8XY1;
+                case 0x2: return OP_8XY2;
+                case 0x3: return OP_8XY3;
+                case 0x4: return OP_8XY4;
+                case 0x5: return OP_8XY5;
+                case 0x6: return OP_8XY6;
+                case 0x7: return OP_8XY7;
+                case 0xE: return OP_8XYE;
+            }
+            break;
+        case 0x9: return OP_9XY0;
+        case 0xA: return OP_ANNN;
+        case 0xB: return OP_BNNN;
+        case 0xC: return OP_CXNN;
+        case 0xD: return OP_DXYN;
+        case 0xE:
+            switch(op & 0x00FF)
+            {
+                case 0xA1: return OP_EXA1;
+                case 0x9E: return OP_EX9E;
+            }
+            break;
+        case 0xF:
+            switch(op & 0x00FF)
+            {
+                case 0x07: return OP_FX07;
+                case 0x0A: return OP_FX0A;
+                case 0x15: return OP_FX15;
+                case 0x18: return OP_FX18;
+                case 0x1E: return OP_FX1E;
+                case 0x29: return OP_FX29;
+                case 0x33: return OP_FX33;
+                case 0x55: return OP_FX55;
+                case 0x65: return OP_FX65;
+            }
+            break;
+    }
+    return OP_TRAP;
+}
+
+bool Chip8::buildOpTable()
+{
+    for(uint32_t op{0}; op < 0x10000; op++)
+    {
+        opTable[op] = decodeOp(op);
+    }
+    return true;
+}
+
+void Chip8::decodeAt(uint16_t addr)
+{
+    DecodedOp& inst = decoded[addr];
+    inst.opcode = (ram[addr] << 8) | (ram[(addr + 1) & (RAM_SIZE - 1)]);
+    inst.Vx = (inst.opcode & 0x0F00) >> 8;
+    inst.Vy = (inst.opcode & 0x00F0) >> 4;
+    inst.N = (inst.opcode & 0x000F);
+    inst.NN = (inst.opcode & 0x00FF);
+    inst.NNN = (inst.opcode & 0x0FFF);
+    inst.handler = opTable[inst.opcode];
+}
+
+void Chip8::invalidate(uint16_t addr, uint16_t length)
+{
+    // the store may have landed in a loop idleBody() already checked, and
+    // a lap with a store in it is no spin-wait either way
+    idleBodyJump = RAM_SIZE;
+    idleProbe.jump = RAM_SIZE;
+
+    // an instruction starting one byte before addr also overlaps the write
+    for(uint16_t i{0}; i <= length; i++)
+    {
+        uint16_t cur = (addr + i - 1) & (RAM_SIZE - 1);
+        decoded[cur].handler = OP_UNDECODED;
+        if(codeMap[cur] & CODE_BLOCK)
+        {
+            blocksStale = true;
+        }
+        if(codeMap[cur] & CODE_STATIC)
+        {
+            staticModified = true;
+        }
+    }
+}
+
+void Chip8::opTrap()
+{
+    // undefined opcodes (and op0NNN) are skipped, same as before
 }
 
 void Chip8::op00E0()
 {
-    memset(display, 0, DISPLAY_SIZE);
+    // clearing a blank screen changes nothing the frontend has to upload
+    uint64_t lit{0};
+    for(uint8_t row{0}; row < DISPLAY_ROWS; row++)
+    {
+        lit |= display[row];
+    }
+    if(lit)
+    {
+        markDirty(0, DISPLAY_ROWS - 1);
+    }
+
+    memset(display, 0, sizeof(display));
+    syncEvents |= SYNC_DISPLAY;
 }
 
 void Chip8::op1NNN()
 {
+    // a short jump back may be a spin-wait, runCycles() takes a look
+    uint16_t jump = pc - 2;
+    if(NNN <= jump && jump - NNN <= 2*MAX_IDLE_LENGTH)
+    {
+        idleEdge = jump;
+        syncEvents |= SYNC_IDLE;
+    }
+
     // sets pc to 0x0NNN
     pc = NNN;
 }
 
+// Stack slots wrap at 16 entries, so deep recursion or a stray return
+// overwrites or reads another slot instead of memory past the stack,
+// unless the strict memory model traps it
 void Chip8::op00EE()
 {
+    if(STRICT_MEMORY && sp == 0)
+    {
+        raiseTrap(TrapKind::StackUnderflow, sp);
+        return;
+    }
     sp--;
-    pc = stack[sp];
+    pc = stack[sp & (STACK_SIZE - 1)];
+    idleProbe.jump = RAM_SIZE;
 }
 
 void Chip8::op2NNN()
 {
-    stack[sp] = pc;
+    if(STRICT_MEMORY && sp >= STACK_SIZE)
+    {
+        raiseTrap(TrapKind::StackOverflow, sp);
+        return;
+    }
+    stack[sp & (STACK_SIZE - 1)] = pc;
     sp++;
     pc = NNN;
+    idleProbe.jump = RAM_SIZE;
 }
 
 void Chip8::op3XNN()
@@ -417,7 +1165,8 @@ void Chip8::opBNNN()
 
 void Chip8::opCXNN()
 {
-    registers[Vx] = randomNum(randomGen) & NN;
+    registers[Vx] = nextRandom() & NN;
+    idleProbe.jump = RAM_SIZE;
 }
 
 void Chip8::opDXYN()
@@ -425,52 +1174,46 @@ void Chip8::opDXYN()
     // Get X and Y coordinates of sprite
     // Note: X = (0, 63), Y = (0, 31)
     // Ex. if Vx = 64, X = 0
-    int8_t xCoord = registers[Vx] % DISPLAY_COLUMNS;
-    int8_t yCoord = registers[Vy] % DISPLAY_ROWS;
+    uint8_t xCoord = registers[Vx] % DISPLAY_COLUMNS;
+    uint8_t yCoord = registers[Vy] % DISPLAY_ROWS;
 
-    uint8_t rowData{0};
-    uint16_t pixelIndex{0};
-    uint8_t pixelBit{0};
-    registers[0xF] = 0;
-    
-    for(uint8_t row{0}; row < N; row++)
+    if(STRICT_MEMORY && trapRange(indexReg, N))
     {
-        // Read first from address pointed by index reg.
-        rowData = ram[indexReg + row];
-        
-        // Getting pixel index
-        pixelIndex = xCoord + (yCoord + row)*DISPLAY_COLUMNS;
+        return;
+    }
+
+    uint64_t collision{0};
+    uint64_t drawn{0};
+    uint8_t row{0};
+    syncEvents |= SYNC_DISPLAY;
 
+    for(; row < N; row++)
+    {
         if(yCoord + row > 31)
         {
             break;
         }
-        for(uint8_t col{0}; col < 8; col++)
-        {
-            if(xCoord + col > 63)
-            {
-                break;
-            }
-            pixelBit = (rowData >> (7 - col)) & 0b1;
-            if (pixelBit) // flip pixel state
-            {
-                // pixel will be turned off
-                if (display[pixelIndex + col] != 0)
-                {
-                    registers[0xF] = 1;
-                }
 
-                display[pixelIndex + col] ^= 0xFF;
-            }
-            
-        }
+        // Line the sprite byte up with its column, anything past column 63
+        // is shifted out which clips the sprite at the right edge
+        uint64_t rowData = (uint64_t)ram[(indexReg + row) & (RAM_SIZE - 1)] << 56 >> xCoord;
+
+        // any pixel that will be turned off sets the flag
+        collision |= display[yCoord + row] & rowData;
+        display[yCoord + row] ^= rowData;
+        drawn |= rowData;
+    }
 
+    registers[0xF] = collision != 0;
+    if(drawn)
+    {
+        markDirty(yCoord, yCoord + row - 1);
     }
 }
 
 void Chip8::opEX9E()
 {
-    if(keypad[registers[Vx]])
+    if(keypad & (1 << (registers[Vx] & 0xF)))
     {
         pc += 2;
     }
@@ -478,7 +1221,7 @@ void Chip8::opEX9E()
 
 void Chip8::opEXA1()
 {
-    if(!keypad[registers[Vx]])
+    if(!(keypad & (1 << (registers[Vx] & 0xF))))
     {
         pc += 2;
     }
@@ -491,100 +1234,34 @@ void Chip8::opFX07()
 
 void Chip8::opFX0A()
 {
-    if(keypad[0x0])
-    {
-        registers[Vx] = 0x0;
-        keyHold = 0;
-    }
-    else if(keypad[0x1])
-    {
-        registers[Vx] = 0x1;
-        keyHold = 1;
-    }
-    else if(keypad[0x2])
-    {
-        registers[Vx] = 0x2;
-        keyHold = 2;
-    }
-    else if(keypad[0x3])
-    {
-        registers[Vx] = 0x3;
-        keyHold = 3;
-    }
-    else if(keypad[0x4])
-    {
-        registers[Vx] = 0x4;
-        keyHold = 4;
-    }
-    else if(keypad[0x5])
-    {
-        registers[Vx] = 0x5;
-        keyHold = 5;
-    }
-    else if(keypad[0x6])
-    {
-        registers[Vx] = 0x6;
-        keyHold = 6;
-    }
-    else if(keypad[0x7])
-    {
-        registers[Vx] = 0x7;
-        keyHold = 7;
-    }
-    else if(keypad[0x8])
-    {
-        registers[Vx] = 0x8;
-        keyHold = 8;
-    }
-    else if(keypad[0x9])
-    {
-        registers[Vx] = 0x9;
-        keyHold = 9;
-    }
-    else if(keypad[0xA])
-    {
-        registers[Vx] = 0xA;
-        keyHold = 10;
-    }
-    else if(keypad[0xB])
-    {
-        registers[Vx] = 0xB;
-        keyHold = 11;
-    }
-    else if(keypad[0xC])
-    {
-        registers[Vx] = 0xC;
-        keyHold = 12;
-    }
-    else if(keypad[0xD])
-    {
-        registers[Vx] = 0xD;
-        keyHold = 13;
-    }
-    else if(keypad[0xE])
-    {
-        registers[Vx] = 0xE;
-        keyHold = 14;
-    }
-    else if(keypad[0xF])
+    // lowest numbered key held, then block until it is released
+    if(keypad)
     {
-        registers[Vx] = 0xF;
-        keyHold = 15;
+        uint8_t key = __builtin_ctz(keypad);
+        registers[Vx] = key;
+        keyWait = KEY_WAIT_RELEASE;
+        keyWaitKey = key;
     }
-    else // no key press, loop
+    else // no key press, block and run FX0A again after one
     {
         pc -= 2;
+        keyWait = KEY_WAIT_PRESS;
     }
-    
+    syncEvents |= SYNC_KEY_WAIT;
 }
 
 void Chip8::opFX15()
 {
     delayTimer = registers[Vx];
+    idleProbe.jump = RAM_SIZE;
 }
 
 void Chip8::opFX18()
 {
+    if(soundTimer == 0 && registers[Vx] > 0)
+    {
+        syncEvents |= SYNC_SOUND;
+    }
     soundTimer = registers[Vx];
 }
 
@@ -601,21 +1278,35 @@ void Chip8::opFX29()
     indexReg = 0x50 + (character * 5);
 }
 
+// Addresses from I wrap around the end of RAM like fetches do, or trap
+// under the strict memory model
 void Chip8::opFX33()
 {
+    if(STRICT_MEMORY && trapRange(indexReg, 3))
+    {
+        return;
+    }
+    invalidate(indexReg, 3);
+
     uint16_t divisor{1000};
     for(uint8_t i{0}; i < 3; i++)
     {
-        ram[indexReg + i] = (registers[Vx] % divisor) / (divisor/10);
+        ram[(indexReg + i) & (RAM_SIZE - 1)] = (registers[Vx] % divisor) / (divisor/10);
         divisor /= 10;
     }
 }
 
 void Chip8::opFX55()
 {
+    if(STRICT_MEMORY && trapRange(indexReg, Vx + 1))
+    {
+        return;
+    }
+    invalidate(indexReg, Vx + 1);
+
     for(uint8_t i{0}; i <= Vx; i++)
     {
-        ram[indexReg + i] = registers[i];
+        ram[(indexReg + i) & (RAM_SIZE - 1)] = registers[i];
     }
 
     indexReg += Vx + 1;
@@ -623,9 +1314,13 @@ void Chip8::opFX55()
 
 void Chip8::opFX65()
 {
+    if(STRICT_MEMORY && trapRange(indexReg, Vx + 1))
+    {
+        return;
+    }
     for(uint8_t i{0}; i <= Vx; i++)
     {
-        registers[i] = ram[indexReg + i];
+        registers[i] = ram[(indexReg + i) & (RAM_SIZE - 1)];
     }
 
     indexReg += Vx + 1;
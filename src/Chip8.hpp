@@ -2,12 +2,11 @@
 #define CHIP8_H
 
 #include <cstdint>
-#include <iostream>
-#include <fstream>
-#include <random>
-#include <chrono>
-#include <filesystem>
+#include <cstddef>
+#include <string>
 #include <cstring>
+#include <algorithm>
+#include <type_traits>
 
 #define DISPLAY_COLUMNS 64
 #define DISPLAY_ROWS 32
@@ -17,7 +16,72 @@
 #define CLOCKHZ 720 
 #define DRAWHZ 60
 #define DELAYHZ 60
+#define MAX_BLOCK_LENGTH 64
+#define MAX_IDLE_LENGTH 8 // longest spin-wait loop body, in instructions
 
+// Events that end runCycles() early, see Chip8::syncEvents
+#define SYNC_DISPLAY 0x1  // 00E0 or DXYN changed the display
+#define SYNC_KEY_WAIT 0x2 // FX0A is blocked on a key press or release
+#define SYNC_SOUND 0x4    // FX18 started the sound timer
+#define SYNC_TRAP 0x8     // the strict memory model stopped the machine
+#define SYNC_IDLE 0x80    // short backward jump, handled inside runCycles()
+
+// codeMap flags
+#define CODE_BLOCK 0x1  // covered by a block of the block engine
+#define CODE_STATIC 0x2 // translated ahead of time (chip8-aot)
+
+static_assert(DISPLAY_COLUMNS == 64, "display rows are stored as uint64_t");
+
+#define STACK_SIZE 16
+
+// Memory model, picked at compile time
+//   fast (default): RAM addresses wrap to 12 bits and stack slots to 4,
+//     nothing is checked and no ROM can reach outside the machine
+//   strict (-DCHIP8_STRICT): an access that would wrap stops the machine
+//     before it happens and leaves a Chip8::Trap saying where and why
+#ifdef CHIP8_STRICT
+#define STRICT_MEMORY true
+#else
+#define STRICT_MEMORY false
+#endif
+
+#define STATE_VERSION 1 // bump whenever Chip8State changes
+#define STATE_HEADER 20 // magic, version, size, checksum
+#define STATE_FILE_SIZE (STATE_HEADER + sizeof(Chip8State)) // a saved state, header and all
+
+/*
+Everything that makes up a running machine, as one flat block of plain
+data with no padding, so a snapshot is a single memcpy and two snapshots
+compare and hash byte for byte. Caches, statistics and frontend flags live
+in Chip8 and are rebuilt or left alone on restore.
+*/
+struct Chip8State
+{
+    uint8_t ram[RAM_SIZE];
+    // One bit per pixel, row major, column 0 is the most significant bit
+    uint64_t display[DISPLAY_ROWS];
+    uint16_t stack[STACK_SIZE];
+    uint16_t indexReg;
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t keypad; // bit k set while key k is held, change with setKey()
+    uint32_t randomState; // xorshift32 for CXNN, never 0
+    uint8_t registers[16];
+    uint8_t sp;
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint8_t keyWait;    // FX0A blocked state, see Chip8::KeyWait
+    uint8_t keyWaitKey; // key that has to be released
+    uint8_t reserved[7]; // always 0, keeps the size a multiple of 8
+};
+
+static_assert(std::is_trivially_copyable<Chip8State>::value, "snapshots are copied with memcpy");
+static_assert(std::has_unique_object_representations<Chip8State>::value, "Chip8State must not have padding");
+
+class Chip8;
+
+// Pointer to an instruction handler, see Chip8::opHandlers
+typedef void (*OpHandler)(Chip8&);
 
 /*
 Chip8 class to "emulate" Chip-8 functionalities
@@ -32,20 +96,57 @@ Below are the Chip-8's specs
     4x4 keypad
 
 */
-class Chip8
+class Chip8 : public Chip8State
 {
+    // shares the opcode table and KeyWait values
+    friend class Chip8Batch;
+
     public:
-        uint8_t ram[RAM_SIZE];
-        uint8_t display[DISPLAY_SIZE];
-        uint16_t indexReg;
-        uint16_t pc;
-        uint16_t stack[16];
-        uint8_t sp;
-        uint8_t delayTimer;
-        uint8_t soundTimer;
-        uint8_t registers[16];
-        uint8_t keypad[16];
-        uint16_t opcode;
+        // Rows changed since the frontend last called clearDirty()
+        bool displayDirty;
+        uint8_t dirtyTop;
+        uint8_t dirtyBottom;
+
+        // Execution engine used by runCycles()
+        //   Interpreter: one instruction at a time through run()
+        //   Blocks: straight-line runs of predecoded instructions
+        //   Verify: Blocks, checked against the interpreter after every block
+        //   Switch: fetch and decode with a switch on every instruction, the
+        //           interpreter before the opcode table, kept as a baseline
+        //           for chip8-bench --switch
+        enum class Engine { Interpreter, Blocks, Verify, Switch };
+        Engine engine;
+        unsigned int verifyMismatches; // blocks that disagreed in Verify mode
+        uint16_t verifyMismatchPc;     // where the last of them ended
+
+        uint8_t syncEvents; // SYNC_* flags raised during the last runCycles()
+
+        // Spin-wait loops (on the delay timer, a key, or jump to self) can't
+        // change anything until runCycles() returns and the frontend ticks
+        // timers or applies input, so once one repeats with identical state
+        // its remaining whole iterations are counted as run instead of run.
+        // The partial iteration left over still executes, so the results are
+        // the same, cycle for cycle, as with skipIdle off.
+        bool skipIdle;
+        uint64_t idleCycles; // cycles skipped that way
+
+        // While FX0A is blocked nothing runs until a key edge arrives. On,
+        // the blocked time still uses up runCycles() budgets as if FX0A was
+        // being re-executed at full clock, like the hardware does. Off,
+        // runCycles() returns 0 while blocked.
+        bool chargeKeyWait;
+
+        // What stopped the machine under the strict memory model, after
+        // which runCycles() runs nothing until reset(), loadState() or
+        // clearTrap(). The fast model never traps.
+        enum class TrapKind : uint8_t { None, StackOverflow, StackUnderflow, MemoryRange, PcRange };
+        struct Trap
+        {
+            TrapKind kind;
+            uint16_t pc;      // of the instruction, pc is left there too
+            uint16_t opcode;  // 0 for PcRange, there was nothing to fetch
+            uint16_t address; // first one out of range, or sp for the stack
+        };
 
     private:
 
@@ -56,21 +157,150 @@ class Chip8
         uint8_t NN;
         uint16_t NNN;
 
-        uint8_t keyHold; // used to halt until key is released
+        // FX0A blocked state in keyWait, cleared by a key edge in setKey()
+        enum KeyWait : uint8_t { KEY_WAIT_NONE, KEY_WAIT_PRESS, KEY_WAIT_RELEASE };
+
+        // Handler indices used by the opcode table
+        enum OpIndex : uint8_t
+        {
+            OP_TRAP,
+            OP_00E0, OP_00EE, OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0,
+            OP_6XNN, OP_7XNN, OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4,
+            OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE, OP_9XY0, OP_ANNN, OP_BNNN,
+            OP_CXNN, OP_DXYN, OP_EX9E, OP_EXA1, OP_FX07, OP_FX0A, OP_FX15,
+            OP_FX18, OP_FX1E, OP_FX29, OP_FX33, OP_FX55, OP_FX65,
+            OP_COUNT,
+            OP_UNDECODED = 0xFF // decode cache entry not filled yet
+        };
+
+        // Fetched and decoded instruction at one address, filled lazily by
+        // run() and cleared again when the bytes underneath are written
+        struct DecodedOp
+        {
+            uint16_t opcode;
+            uint16_t NNN;
+            uint8_t handler;
+            uint8_t Vx;
+            uint8_t Vy;
+            uint8_t N;
+            uint8_t NN;
+        };
+
+        DecodedOp decoded[RAM_SIZE];
+
+        // Block engine: number of instructions in the block starting at each
+        // address (0 = not built) and which bytes are covered by some block
+        uint8_t blockLength[RAM_SIZE];
+        uint8_t codeMap[RAM_SIZE];
+        bool blocksStale; // a store hit block code, rebuild before next block
+        bool staticModified; // a store hit ahead-of-time translated code
+
+        // Idle loop detection: the back edge last taken in this runCycles()
+        // call, when, and the state it left behind
+        struct IdleProbe
+        {
+            uint16_t jump;
+            unsigned int cycle;
+            uint16_t indexReg;
+            uint8_t registers[16];
+        };
+        IdleProbe idleProbe;
+        uint16_t idleEdge;       // jump that raised SYNC_IDLE
+        uint16_t idleBodyJump;   // loop last checked by idleBody(), cached
+        bool idleBodyPure;
+
+        Trap trap;
+
+        uint8_t nextRandom();
+
+        // Every raw opcode maps to a handler index, built once at startup
+        // so run() only needs a single indirect call per instruction
+        static const OpHandler opHandlers[OP_COUNT];
+        static uint8_t opTable[0x10000];
+        static const bool opTableReady;
 
-        // Random number generation
-        std::mt19937 randomGen;
-        std::uniform_int_distribution<> randomNum;
+        static uint8_t decodeOp(uint16_t op);
+        static bool buildOpTable();
+
+        void decodeAt(uint16_t addr);
+        void invalidate(uint16_t addr, uint16_t length);
+        void execute(const DecodedOp& inst);
+        void runSwitch();
+
+        // Strict memory model checks, true once they have raised a trap
+        bool trapFetch();
+        bool trapRange(uint16_t addr, unsigned int length);
+        void raiseTrap(TrapKind kind, uint16_t address);
+
+        static bool endsBlock(uint8_t handler);
+        void buildBlock(uint16_t addr);
+        unsigned int runBlock(unsigned int budget);
+        unsigned int verifyBlock(unsigned int budget);
+        bool sameState(const Chip8& other) const;
+
+        bool idleBody(uint16_t jump);
+        unsigned int fastForwardIdle(unsigned int cycle, unsigned int left);
+
+        // Plain function wrapper so the handler body gets inlined into it
+        template<void (Chip8::*Op)()>
+        static void opThunk(Chip8& chip)
+        {
+            (chip.*Op)();
+        }
 
     public:
         Chip8();
-        void loadROM(const std::string fileName);
+        void reset(); // power cycle, keeps engine, skipIdle and chargeKeyWait
+        void loadROM(const std::string fileName); // Chip8File.cpp
+        bool loadROM(const uint8_t* data, size_t size);
         void tickTimers();
+        uint64_t stateHash() const;
+        static uint64_t hashState(const Chip8State& state);
+        void clearDirty();
+        void markDirty(uint8_t firstRow, uint8_t lastRow);
+        // The display as DISPLAY_SIZE/8 bytes, row by row, leftmost pixel in the top bit
+        void packDisplay(uint8_t* out) const;
+        void seedRandom(uint32_t seed); // for reproducible CXNN results
+
+        // Snapshots: the state itself, readable in place, and full restores.
+        // Restoring only drops cached decodes of code that differs.
+        const Chip8State& state() const;
+        void saveState(Chip8State& out) const;
+        void loadState(const Chip8State& in);
+        // Versioned, checksummed save, STATE_FILE_SIZE bytes in memory or
+        // as a file (Chip8File.cpp). Saving returns the bytes written, 0 if
+        // out is too small, loading false if the save can't be used.
+        size_t saveState(uint8_t* out, size_t size) const;
+        bool loadState(const uint8_t* in, size_t size);
+        bool saveState(const std::string& fileName) const;
+        bool loadState(const std::string& fileName);
+
+        // Key press and release edges, these also end an FX0A wait
+        void setKey(uint8_t key, bool pressed);
+        void setKeys(uint16_t mask);
 
         void run();
+        // Runs up to budget instructions, stopping early after a sync event
+        // Returns the number of cycles actually used
+        unsigned int runCycles(unsigned int budget);
+        // One frame: CLOCKHZ/DRAWHZ cycles, fewer once FX0A blocks, then the
+        // timers. The remainders carry what doesn't divide evenly to the next.
+        unsigned int runFrame(unsigned int& cycleRemainder, unsigned int& timerRemainder);
+
+        // Used by code generated with chip8-aot
+        void runOpcode(uint16_t op); // execute op as if it was fetched at pc
+        void markStaticCode(uint16_t addr, uint16_t length);
+        bool staticCodeModified() const;
+        bool waitingForKey() const;
+
+        bool trapped() const;
+        const Trap& getTrap() const;
+        void clearTrap();
+        static const char* trapName(TrapKind kind);
 
         // Instructions
         // op0NNN (unimplemented; unnecessary)
+        void opTrap(); // undefined opcodes end up here
         void op00E0();
         void op1NNN();
         void op00EE();
@@ -0,0 +1,807 @@
+#include "Chip8Batch.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+#define CODE_CHUNK 64 // sharedCode granularity in bytes
+#define LANE_BLOCK 32 // lanes per loop block, one AVX2 register of bytes
+
+// Calls body(lane) for every lane of the blocks covering first..end-1.
+// Lanes outside the group are visited too, bodies blend on group[lane].
+// The fixed trip count, and ivdep promising that the lane arrays don't
+// overlap, let the compiler turn each block into straight vector code.
+// in[lane] is 0xFF or 0, as a mask of the width of T
+template<typename T>
+static inline T laneMask(uint8_t in)
+{
+    return (T)(int8_t)in;
+}
+
+// a where the mask is set, b elsewhere, without a branch
+template<typename T>
+static inline T blend(T mask, T a, T b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+template<typename Body>
+__attribute__((always_inline)) static inline void forLanes(unsigned int first, unsigned int end, Body body)
+{
+    for(unsigned int block{first / LANE_BLOCK}; block < (end + LANE_BLOCK - 1) / LANE_BLOCK; block++)
+    {
+        const unsigned int base{block * LANE_BLOCK};
+        #pragma GCC ivdep
+        for(unsigned int i{0}; i < LANE_BLOCK; i++)
+        {
+            body(base + i);
+        }
+    }
+}
+
+Chip8Batch::Chip8Batch(unsigned int lanes) : count(lanes > 0 ? lanes : 1)
+{
+    stride = (count + LANE_BLOCK - 1) / LANE_BLOCK * LANE_BLOCK;
+    registers.resize(16 * stride);
+    stack.resize(16 * stride);
+    pc.resize(stride);
+    indexReg.resize(stride);
+    opcode.resize(stride);
+    keypad.resize(stride);
+    randomState.resize(stride);
+    sp.resize(stride);
+    delayTimer.resize(stride);
+    soundTimer.resize(stride);
+    keyWait.resize(stride);
+    keyWaitKey.resize(stride);
+    memory.resize((size_t)RAM_SIZE * count);
+    screen.resize(DISPLAY_ROWS * count);
+    left.resize(stride); // stays 0 past count
+    group.resize(stride);
+    sharedCode.resize(RAM_SIZE / CODE_CHUNK);
+
+    // the same power on state a Chip8 starts from
+    Chip8 power;
+    power.saveState(powerOn);
+
+    kernel = bestKernel();
+    reset();
+}
+
+unsigned int Chip8Batch::lanes() const
+{
+    return count;
+}
+
+void Chip8Batch::reset()
+{
+    for(unsigned int lane{0}; lane < count; lane++)
+    {
+        reset(lane);
+    }
+    std::fill(sharedCode.begin(), sharedCode.end(), 1);
+    cycleRemainder = 0;
+    timerRemainder = 0;
+    stats = {0, 0, 0};
+}
+
+void Chip8Batch::reset(unsigned int lane)
+{
+    loadState(lane, powerOn);
+    seedRandom(lane, lane);
+}
+
+bool Chip8Batch::loadROM(const uint8_t* data, size_t size)
+{
+    if(size > (RAM_SIZE - RAM_START))
+    {
+        return false;
+    }
+    for(unsigned int lane{0}; lane < count; lane++)
+    {
+        memcpy(&memory[(size_t)lane * RAM_SIZE + RAM_START], data, size);
+    }
+    // chunks the ROM covers completely are now the same everywhere
+    for(size_t chunk{(RAM_START + CODE_CHUNK - 1) / CODE_CHUNK}; (chunk + 1) * CODE_CHUNK <= RAM_START + size; chunk++)
+    {
+        sharedCode[chunk] = 1;
+    }
+    return true;
+}
+
+void Chip8Batch::seedRandom(unsigned int lane, uint32_t seed)
+{
+    // same spreading as Chip8::seedRandom
+    randomState[lane] = (seed * 0x9E3779B9) | 0x1;
+}
+
+void Chip8Batch::setKeys(unsigned int lane, uint16_t mask)
+{
+    uint16_t changed = keypad[lane] ^ mask;
+    for(uint8_t key{0}; key < 16; key++)
+    {
+        if(!(changed & (1 << key)))
+        {
+            continue;
+        }
+        bool pressed = mask & (1 << key);
+        keypad[lane] ^= 1 << key;
+        if((keyWait[lane] == Chip8::KEY_WAIT_PRESS && pressed)
+            || (keyWait[lane] == Chip8::KEY_WAIT_RELEASE && !pressed && key == keyWaitKey[lane]))
+        {
+            keyWait[lane] = Chip8::KEY_WAIT_NONE;
+        }
+    }
+}
+
+void Chip8Batch::saveState(unsigned int lane, Chip8State& out) const
+{
+    memset(&out, 0, sizeof(Chip8State));
+    memcpy(out.ram, &memory[(size_t)lane * RAM_SIZE], RAM_SIZE);
+    memcpy(out.display, &screen[lane * DISPLAY_ROWS], sizeof(out.display));
+    for(unsigned int i{0}; i < 16; i++)
+    {
+        out.stack[i] = stack[i * stride + lane];
+        out.registers[i] = registers[i * stride + lane];
+    }
+    out.indexReg = indexReg[lane];
+    out.pc = pc[lane];
+    out.opcode = opcode[lane];
+    out.keypad = keypad[lane];
+    out.randomState = randomState[lane];
+    out.sp = sp[lane];
+    out.delayTimer = delayTimer[lane];
+    out.soundTimer = soundTimer[lane];
+    out.keyWait = keyWait[lane];
+    out.keyWaitKey = keyWaitKey[lane];
+}
+
+void Chip8Batch::loadState(unsigned int lane, const Chip8State& in)
+{
+    uint8_t* ram{&memory[(size_t)lane * RAM_SIZE]};
+    for(unsigned int chunk{0}; chunk < RAM_SIZE / CODE_CHUNK; chunk++)
+    {
+        if(memcmp(ram + chunk * CODE_CHUNK, in.ram + chunk * CODE_CHUNK, CODE_CHUNK) != 0)
+        {
+            sharedCode[chunk] = 0;
+        }
+    }
+    memcpy(ram, in.ram, RAM_SIZE);
+    memcpy(&screen[lane * DISPLAY_ROWS], in.display, sizeof(in.display));
+    for(unsigned int i{0}; i < 16; i++)
+    {
+        stack[i * stride + lane] = in.stack[i];
+        registers[i * stride + lane] = in.registers[i];
+    }
+    indexReg[lane] = in.indexReg;
+    pc[lane] = in.pc;
+    opcode[lane] = in.opcode;
+    keypad[lane] = in.keypad;
+    randomState[lane] = in.randomState;
+    sp[lane] = in.sp;
+    delayTimer[lane] = in.delayTimer;
+    soundTimer[lane] = in.soundTimer;
+    keyWait[lane] = in.keyWait;
+    keyWaitKey[lane] = in.keyWaitKey;
+}
+
+uint64_t Chip8Batch::stateHash(unsigned int lane) const
+{
+    Chip8State state;
+    saveState(lane, state);
+    return Chip8::hashState(state);
+}
+
+const uint64_t* Chip8Batch::display(unsigned int lane) const
+{
+    return &screen[lane * DISPLAY_ROWS];
+}
+
+const uint8_t* Chip8Batch::ram(unsigned int lane) const
+{
+    return &memory[(size_t)lane * RAM_SIZE];
+}
+
+void Chip8Batch::setKernel(Kernel kernel)
+{
+    this->kernel = std::min(kernel, bestKernel());
+}
+
+Chip8Batch::Kernel Chip8Batch::getKernel() const
+{
+    return kernel;
+}
+
+Chip8Batch::Kernel Chip8Batch::bestKernel()
+{
+#ifdef BATCH_X86
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return Kernel::AVX2;
+    }
+#endif
+    return Kernel::Scalar;
+}
+
+const Chip8Batch::Stats& Chip8Batch::getStats() const
+{
+    return stats;
+}
+
+void Chip8Batch::runFrame()
+{
+    cycleRemainder += CLOCKHZ;
+    unsigned int frameCycles{cycleRemainder / DRAWHZ};
+    cycleRemainder %= DRAWHZ;
+
+    // a lane blocked in FX0A stays blocked until setKeys() brings an edge
+    for(unsigned int lane{0}; lane < count; lane++)
+    {
+        left[lane] = keyWait[lane] == Chip8::KEY_WAIT_NONE ? frameCycles : 0;
+    }
+
+    unsigned int first{0};
+    unsigned int end{0};
+    unsigned int size{0};
+    uint16_t groupPc{0};
+    unsigned int nextPc{0};
+    bool holds{false};
+    while(true)
+    {
+        // keep stepping the same group while it agrees and hasn't caught
+        // up with the next lane, looking for a new one is a pass over
+        // every lane
+        groupPc = pc[first];
+        if(!holds || groupPc >= nextPc)
+        {
+            size = kernel == Kernel::AVX2 ? findGroupAVX2(first, end, groupPc, nextPc)
+                                          : findGroup(first, end, groupPc, nextPc);
+            if(size == 0)
+            {
+                break;
+            }
+        }
+
+        uint16_t addr = groupPc & (RAM_SIZE - 1);
+        uint16_t op;
+        if(sharedCode[addr / CODE_CHUNK] && sharedCode[((addr + 1) & (RAM_SIZE - 1)) / CODE_CHUNK])
+        {
+            op = fetch(first, addr);
+        }
+        else
+        {
+            // lanes that wrote different code here run it in a later group
+            size = splitOpcode(first, end, addr, op);
+            nextPc = groupPc;
+        }
+
+        holds = execute(op, first, end);
+        stats.steps++;
+        stats.laneCycles += size;
+        stats.singleSteps += size == 1;
+    }
+
+    timerRemainder += DELAYHZ;
+    for(unsigned int tick{0}; tick < timerRemainder / DRAWHZ; tick++)
+    {
+        forLanes(0, stride, [&](unsigned int lane)
+        {
+            soundTimer[lane] -= soundTimer[lane] > 0;
+            delayTimer[lane] -= delayTimer[lane] > 0;
+        });
+    }
+    timerRemainder %= DRAWHZ;
+}
+
+unsigned int Chip8Batch::findGroup(unsigned int& first, unsigned int& end, uint16_t& groupPc, unsigned int& nextPc)
+{
+    unsigned int lowest{0x10000};
+    for(unsigned int lane{0}; lane < count; lane++)
+    {
+        if(left[lane] && pc[lane] < lowest)
+        {
+            lowest = pc[lane];
+        }
+    }
+    if(lowest == 0x10000)
+    {
+        return 0;
+    }
+
+    unsigned int size{0};
+    nextPc = 0x10000;
+    for(unsigned int lane{0}; lane < stride; lane++)
+    {
+        bool in{left[lane] && pc[lane] == lowest};
+        group[lane] = in ? 0xFF : 0;
+        if(in)
+        {
+            first = size == 0 ? lane : first;
+            end = lane + 1;
+            size++;
+        }
+        else if(left[lane] && pc[lane] < nextPc)
+        {
+            nextPc = pc[lane];
+        }
+    }
+    groupPc = lowest;
+    return size;
+}
+
+#ifdef BATCH_X86
+
+__attribute__((target("avx2")))
+unsigned int Chip8Batch::findGroupAVX2(unsigned int& first, unsigned int& end, uint16_t& groupPc, unsigned int& nextPc)
+{
+    // lanes with no cycles left, padding included, count as pc 0xFFFF
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(-1);
+    __m256i lowest = ones;
+    for(unsigned int lane{0}; lane < stride; lane += 16)
+    {
+        __m256i done = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)&left[lane]), zero);
+        lowest = _mm256_min_epu16(lowest, _mm256_or_si256(_mm256_loadu_si256((const __m256i*)&pc[lane]), done));
+    }
+    __m128i half = _mm_min_epu16(_mm256_castsi256_si128(lowest), _mm256_extracti128_si256(lowest, 1));
+    unsigned int low = _mm_extract_epi16(_mm_minpos_epu16(half), 0);
+    // no lanes left, or only ones really at pc 0xFFFF which the plain pass sorts out
+    if(low == 0xFFFF)
+    {
+        return findGroup(first, end, groupPc, nextPc);
+    }
+
+    const __m256i target = _mm256_set1_epi16(low);
+    __m256i next = ones;
+    unsigned int size{0};
+    first = stride;
+    for(unsigned int lane{0}; lane < stride; lane += 32)
+    {
+        __m256i in[2];
+        for(int i{0}; i < 2; i++)
+        {
+            __m256i pcs = _mm256_loadu_si256((const __m256i*)&pc[lane + 16*i]);
+            __m256i done = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)&left[lane + 16*i]), zero);
+            in[i] = _mm256_andnot_si256(done, _mm256_cmpeq_epi16(pcs, target));
+            // every other lane with cycles left bids for the next pc
+            next = _mm256_min_epu16(next, _mm256_or_si256(pcs, _mm256_or_si256(in[i], done)));
+        }
+        // packing works within 128 bit halves, the permute puts lanes back in order
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packs_epi16(in[0], in[1]), 0xD8);
+        _mm256_storeu_si256((__m256i*)&group[lane], bytes);
+        uint32_t bits = _mm256_movemask_epi8(bytes);
+        if(bits)
+        {
+            first = std::min(first, lane + __builtin_ctz(bits));
+            end = lane + 32 - __builtin_clz(bits);
+            size += __builtin_popcount(bits);
+        }
+    }
+    half = _mm_min_epu16(_mm256_castsi256_si128(next), _mm256_extracti128_si256(next, 1));
+    nextPc = _mm_extract_epi16(_mm_minpos_epu16(half), 0);
+    if(nextPc == 0xFFFF)
+    {
+        nextPc = 0x10000;
+    }
+    groupPc = low;
+    return size;
+}
+
+#else
+
+unsigned int Chip8Batch::findGroupAVX2(unsigned int& first, unsigned int& end, uint16_t& groupPc, unsigned int& nextPc)
+{
+    return findGroup(first, end, groupPc, nextPc);
+}
+
+#endif
+
+uint16_t Chip8Batch::fetch(unsigned int lane, uint16_t addr) const
+{
+    const uint8_t* ram{&memory[(size_t)lane * RAM_SIZE]};
+    return (ram[addr] << 8) | ram[(addr + 1) & (RAM_SIZE - 1)];
+}
+
+unsigned int Chip8Batch::splitOpcode(unsigned int first, unsigned int& end, uint16_t addr, uint16_t& op)
+{
+    op = fetch(first, addr);
+    unsigned int size{0};
+    unsigned int last{first};
+    for(unsigned int lane{first}; lane < end; lane++)
+    {
+        if(group[lane] && fetch(lane, addr) != op)
+        {
+            group[lane] = 0;
+        }
+        if(group[lane])
+        {
+            size++;
+            last = lane;
+        }
+    }
+    end = last + 1;
+    return size;
+}
+
+void Chip8Batch::writeRam(unsigned int lane, uint16_t addr, uint8_t value)
+{
+    addr &= RAM_SIZE - 1;
+    uint8_t& byte{memory[(size_t)lane * RAM_SIZE + addr]};
+    if(byte != value)
+    {
+        byte = value;
+        sharedCode[addr / CODE_CHUNK] = 0;
+    }
+}
+
+bool Chip8Batch::execute(uint16_t op, unsigned int first, unsigned int end)
+{
+#ifdef BATCH_X86
+    if(kernel == Kernel::AVX2)
+    {
+        return executeAVX2(op, first, end);
+    }
+#endif
+    return executeLanes(op, first, end);
+}
+
+#ifdef BATCH_X86
+
+// the same code, vectorized for 32 byte registers
+__attribute__((target("avx2")))
+bool Chip8Batch::executeAVX2(uint16_t op, unsigned int first, unsigned int end)
+{
+    return executeLanes(op, first, end);
+}
+
+#else
+
+bool Chip8Batch::executeAVX2(uint16_t op, unsigned int first, unsigned int end)
+{
+    return executeLanes(op, first, end);
+}
+
+#endif
+
+__attribute__((always_inline)) inline
+bool Chip8Batch::executeLanes(uint16_t op, unsigned int first, unsigned int end)
+{
+    const uint8_t x = (op & 0x0F00) >> 8;
+    const uint8_t y = (op & 0x00F0) >> 4;
+    const uint8_t n = op & 0x000F;
+    const uint8_t nn = op & 0x00FF;
+    const uint16_t nnn = op & 0x0FFF;
+    const uint8_t* in{group.data()};
+    uint8_t* vx{reg(x)};
+    uint8_t* vy{reg(y)};
+    uint8_t* vf{reg(0xF)};
+
+    // plain pointers, so the compiler needn't reload each vector's data
+    // pointer after every byte store
+    uint16_t* pc{this->pc.data()};
+    uint16_t* left{this->left.data()};
+    uint16_t* opcode{this->opcode.data()};
+    uint16_t* indexReg{this->indexReg.data()};
+    uint16_t* keypad{this->keypad.data()};
+    uint32_t* randomState{this->randomState.data()};
+    uint8_t* delayTimer{this->delayTimer.data()};
+    uint8_t* soundTimer{this->soundTimer.data()};
+
+    // what Chip8::execute() does before the handler
+    forLanes(first, end, [&](unsigned int lane)
+    {
+        uint16_t mask = laneMask<uint16_t>(in[lane]);
+        pc[lane] += 2 & mask;
+        left[lane] -= 1 & mask;
+        opcode[lane] = blend<uint16_t>(mask, op, opcode[lane]);
+    });
+
+    // 8XYN, VF is written last so it ends up holding the flag when it is
+    // also the destination
+    auto alu = [&](auto operation)
+    {
+        forLanes(first, end, [&](unsigned int lane)
+        {
+            uint8_t result, flag;
+            operation(vx[lane], vy[lane], result, flag);
+            vx[lane] = blend<uint8_t>(in[lane], result, vx[lane]);
+            vf[lane] = blend<uint8_t>(in[lane], flag, vf[lane]);
+        });
+    };
+
+    switch(Chip8::opTable[op])
+    {
+        case Chip8::OP_TRAP:
+            break;
+
+        case Chip8::OP_00E0:
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(in[lane])
+                {
+                    memset(&screen[lane * DISPLAY_ROWS], 0, DISPLAY_ROWS * sizeof(uint64_t));
+                }
+            }
+            break;
+
+        case Chip8::OP_00EE:
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(in[lane])
+                {
+                    sp[lane]--;
+                    pc[lane] = stack[(sp[lane] & 0xF) * stride + lane];
+                }
+            }
+            break;
+
+        case Chip8::OP_1NNN:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] = blend<uint16_t>(laneMask<uint16_t>(in[lane]), nnn, pc[lane]);
+            });
+            break;
+
+        case Chip8::OP_2NNN:
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(in[lane])
+                {
+                    stack[(sp[lane] & 0xF) * stride + lane] = pc[lane];
+                    sp[lane]++;
+                    pc[lane] = nnn;
+                }
+            }
+            break;
+
+        case Chip8::OP_3XNN:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] += 2 & laneMask<uint16_t>(in[lane]) & -(uint16_t)(vx[lane] == nn);
+            });
+            break;
+
+        case Chip8::OP_4XNN:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] += 2 & laneMask<uint16_t>(in[lane]) & -(uint16_t)(vx[lane] != nn);
+            });
+            break;
+
+        case Chip8::OP_5XY0:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] += 2 & laneMask<uint16_t>(in[lane]) & -(uint16_t)(vx[lane] == vy[lane]);
+            });
+            break;
+
+        case Chip8::OP_9XY0:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] += 2 & laneMask<uint16_t>(in[lane]) & -(uint16_t)(vx[lane] != vy[lane]);
+            });
+            break;
+
+        case Chip8::OP_6XNN:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                vx[lane] = blend<uint8_t>(in[lane], nn, vx[lane]);
+            });
+            break;
+
+        case Chip8::OP_7XNN:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                vx[lane] += nn & in[lane];
+            });
+            break;
+
+        case Chip8::OP_8XY0:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                vx[lane] = blend<uint8_t>(in[lane], vy[lane], vx[lane]);
+            });
+            break;
+
+        case Chip8::OP_8XY1:
+            alu([](uint8_t a, uint8_t b, uint8_t& result, uint8_t& flag) { result = a | b; flag = 0; });
+            break;
+        case Chip8::OP_8XY2:
+            alu([](uint8_t a, uint8_t b, uint8_t& result, uint8_t& flag) { result = a & b; flag = 0; });
+            break;
+        case Chip8::OP_8XY3:
+            alu([](uint8_t a, uint8_t b, uint8_t& result, uint8_t& flag) { result = a ^ b; flag = 0; });
+            break;
+        case Chip8::OP_8XY4:
+            alu([](uint8_t a, uint8_t b, uint8_t& result, uint8_t& flag) { result = a + b; flag = result < a; });
+            break;
+        case Chip8::OP_8XY5:
+            alu([](uint8_t a, uint8_t b, uint8_t& result, uint8_t& flag) { result = a - b; flag = a >= b; });
+            break;
+        case Chip8::OP_8XY6:
+            alu([](uint8_t, uint8_t b, uint8_t& result, uint8_t& flag) { result = b >> 1; flag = b & 0x1; });
+            break;
+        case Chip8::OP_8XY7:
+            alu([](uint8_t a, uint8_t b, uint8_t& result, uint8_t& flag) { result = b - a; flag = b >= a; });
+            break;
+        case Chip8::OP_8XYE:
+            alu([](uint8_t, uint8_t b, uint8_t& result, uint8_t& flag) { result = b << 1; flag = b >> 7; });
+            break;
+
+        case Chip8::OP_ANNN:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                indexReg[lane] = blend<uint16_t>(laneMask<uint16_t>(in[lane]), nnn, indexReg[lane]);
+            });
+            break;
+
+        case Chip8::OP_BNNN:
+        {
+            const uint8_t* v0{reg(0)};
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] = blend<uint16_t>(laneMask<uint16_t>(in[lane]), v0[lane] + nnn, pc[lane]);
+            });
+            break;
+        }
+
+        case Chip8::OP_CXNN:
+            // xorshift32 as in Chip8::nextRandom, every lane its own stream
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                uint32_t state{randomState[lane]};
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                randomState[lane] = blend<uint32_t>(laneMask<uint32_t>(in[lane]), state, randomState[lane]);
+                vx[lane] = blend<uint8_t>(in[lane], (state >> 24) & nn, vx[lane]);
+            });
+            break;
+
+        case Chip8::OP_DXYN:
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(!in[lane])
+                {
+                    continue;
+                }
+                const uint8_t* ram{&memory[(size_t)lane * RAM_SIZE]};
+                uint64_t* display{&screen[lane * DISPLAY_ROWS]};
+                uint8_t xCoord = vx[lane] % DISPLAY_COLUMNS;
+                uint8_t yCoord = vy[lane] % DISPLAY_ROWS;
+                uint64_t collision{0};
+                for(uint8_t row{0}; row < n && yCoord + row < DISPLAY_ROWS; row++)
+                {
+                    uint64_t rowData = (uint64_t)ram[(indexReg[lane] + row) & (RAM_SIZE - 1)] << 56 >> xCoord;
+                    collision |= display[yCoord + row] & rowData;
+                    display[yCoord + row] ^= rowData;
+                }
+                vf[lane] = collision != 0;
+            }
+            break;
+
+        case Chip8::OP_EX9E:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] += 2 & laneMask<uint16_t>(in[lane]) & -(uint16_t)((keypad[lane] >> (vx[lane] & 0xF)) & 0x1);
+            });
+            break;
+
+        case Chip8::OP_EXA1:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                pc[lane] += 2 & laneMask<uint16_t>(in[lane]) & ~-(uint16_t)((keypad[lane] >> (vx[lane] & 0xF)) & 0x1);
+            });
+            break;
+
+        case Chip8::OP_FX07:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                vx[lane] = blend<uint8_t>(in[lane], delayTimer[lane], vx[lane]);
+            });
+            break;
+
+        case Chip8::OP_FX0A:
+            // the lane's frame ends here either way, as in Chip8::runCycles()
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(!in[lane])
+                {
+                    continue;
+                }
+                if(keypad[lane])
+                {
+                    uint8_t key = __builtin_ctz(keypad[lane]);
+                    vx[lane] = key;
+                    keyWait[lane] = Chip8::KEY_WAIT_RELEASE;
+                    keyWaitKey[lane] = key;
+                }
+                else
+                {
+                    pc[lane] -= 2;
+                    keyWait[lane] = Chip8::KEY_WAIT_PRESS;
+                }
+                left[lane] = 0;
+            }
+            break;
+
+        case Chip8::OP_FX15:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                delayTimer[lane] = blend<uint8_t>(in[lane], vx[lane], delayTimer[lane]);
+            });
+            break;
+
+        case Chip8::OP_FX18:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                soundTimer[lane] = blend<uint8_t>(in[lane], vx[lane], soundTimer[lane]);
+            });
+            break;
+
+        case Chip8::OP_FX1E:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                indexReg[lane] += vx[lane] & laneMask<uint16_t>(in[lane]);
+            });
+            break;
+
+        case Chip8::OP_FX29:
+            forLanes(first, end, [&](unsigned int lane)
+            {
+                indexReg[lane] = blend<uint16_t>(laneMask<uint16_t>(in[lane]), 0x50 + vx[lane] * 5, indexReg[lane]);
+            });
+            break;
+
+        case Chip8::OP_FX33:
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(in[lane])
+                {
+                    writeRam(lane, indexReg[lane], vx[lane] / 100);
+                    writeRam(lane, indexReg[lane] + 1, vx[lane] / 10 % 10);
+                    writeRam(lane, indexReg[lane] + 2, vx[lane] % 10);
+                }
+            }
+            break;
+
+        case Chip8::OP_FX55:
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(in[lane])
+                {
+                    for(uint8_t i{0}; i <= x; i++)
+                    {
+                        writeRam(lane, indexReg[lane] + i, registers[i * stride + lane]);
+                    }
+                    indexReg[lane] += x + 1;
+                }
+            }
+            break;
+
+        case Chip8::OP_FX65:
+            for(unsigned int lane{first}; lane < end; lane++)
+            {
+                if(in[lane])
+                {
+                    const uint8_t* ram{&memory[(size_t)lane * RAM_SIZE]};
+                    for(uint8_t i{0}; i <= x; i++)
+                    {
+                        registers[i * stride + lane] = ram[(indexReg[lane] + i) & (RAM_SIZE - 1)];
+                    }
+                    indexReg[lane] += x + 1;
+                }
+            }
+            break;
+    }
+
+    // whether the group can take the next step together
+    const uint16_t next{pc[first]};
+    uint8_t apart{0};
+    forLanes(first, end, [&](unsigned int lane)
+    {
+        apart |= in[lane] & ((pc[lane] != next) | (left[lane] == 0));
+    });
+    return !apart;
+}
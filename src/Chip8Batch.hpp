@@ -0,0 +1,111 @@
+#ifndef CHIP8BATCH_H
+#define CHIP8BATCH_H
+
+#include <cstdint>
+#include <vector>
+#include "Chip8.hpp"
+
+/*
+Chip8Batch runs many copies of one ROM in lockstep
+Every piece of machine state is kept as an array over the lanes (one per
+instance), register r of every lane side by side, so one instruction can
+be applied to a whole group of lanes at once. Each step picks the lanes at
+the lowest pc that still have cycles left this frame and runs their shared
+opcode over all of them, as straight loops over blocks of 32 lanes that
+the compiler turns into vector code, built a second time for AVX2 (32 byte
+registers) and picked at runtime when the CPU has it. Lanes that branched elsewhere simply wait
+for a later step; picking the lowest pc first lets lanes that fell behind
+catch up and merge again at the next loop head. A group of one lane is the
+scalar fallback for lanes that have diverged for good.
+Lanes never affect each other, so the order lanes are stepped in doesn't
+change any result: each lane ends every frame in exactly the state a Chip8
+under a FixedStep Scheduler would, hash for hash, RAM addresses and
+stack slots wrapping (to 12 and 4 bits) the same way. Lanes always use
+the fast memory model, even in builds where Chip8 is strict.
+*/
+class Chip8Batch
+{
+    public:
+        enum class Kernel { Scalar, AVX2 };
+
+        struct Stats
+        {
+            uint64_t steps;        // group instructions issued
+            uint64_t laneCycles;   // instructions executed over all lanes
+            uint64_t singleSteps;  // steps that ran one lane on its own
+        };
+
+        Chip8Batch(unsigned int lanes);
+
+        unsigned int lanes() const;
+        void reset();                 // every lane to power on, seeded with its lane number
+        void reset(unsigned int lane);
+        bool loadROM(const uint8_t* data, size_t size); // into every lane
+
+        void seedRandom(unsigned int lane, uint32_t seed);
+        void setKeys(unsigned int lane, uint16_t mask); // edges end FX0A waits like Chip8::setKeys
+
+        // One Scheduler frame for every lane: CLOCKHZ/DRAWHZ cycles, then
+        // the timers. Lanes blocked in FX0A sit the frame out.
+        void runFrame();
+
+        void saveState(unsigned int lane, Chip8State& out) const;
+        void loadState(unsigned int lane, const Chip8State& in);
+        uint64_t stateHash(unsigned int lane) const; // same as Chip8::stateHash()
+        const uint64_t* display(unsigned int lane) const; // DISPLAY_ROWS rows, like Chip8::display
+        const uint8_t* ram(unsigned int lane) const;
+
+        void setKernel(Kernel kernel); // falls back if the CPU lacks it
+        Kernel getKernel() const;
+        static Kernel bestKernel();
+        const Stats& getStats() const;
+
+    private:
+        unsigned int count;
+        unsigned int stride; // count rounded up to whole blocks, the extra lanes never run
+        Kernel kernel;
+        Stats stats;
+        Chip8State powerOn; // what reset() restores, fonts and all
+
+        // CLOCKHZ and DELAYHZ need not divide DRAWHZ, as in Scheduler
+        unsigned int cycleRemainder;
+        unsigned int timerRemainder;
+
+        // Per lane state, register r of lane l at registers[r*stride + l],
+        // RAM and display lane after lane
+        std::vector<uint8_t> registers;
+        std::vector<uint16_t> stack;
+        std::vector<uint16_t> pc;
+        std::vector<uint16_t> indexReg;
+        std::vector<uint16_t> opcode;
+        std::vector<uint16_t> keypad;
+        std::vector<uint32_t> randomState;
+        std::vector<uint8_t> sp;
+        std::vector<uint8_t> delayTimer;
+        std::vector<uint8_t> soundTimer;
+        std::vector<uint8_t> keyWait;
+        std::vector<uint8_t> keyWaitKey;
+        std::vector<uint8_t> memory;
+        std::vector<uint64_t> screen;
+
+        // Scheduling
+        std::vector<uint16_t> left;  // cycles left in this frame
+        std::vector<uint8_t> group;  // 0xFF for lanes in the group being stepped
+        // one flag per 64 byte chunk of RAM, set while it is the same in
+        // every lane so an opcode fetched there is every lane's opcode
+        std::vector<uint8_t> sharedCode;
+
+        uint8_t* reg(uint8_t r) { return &registers[r * stride]; }
+        unsigned int findGroup(unsigned int& first, unsigned int& end, uint16_t& groupPc, unsigned int& nextPc);
+        unsigned int findGroupAVX2(unsigned int& first, unsigned int& end, uint16_t& groupPc, unsigned int& nextPc);
+        unsigned int splitOpcode(unsigned int first, unsigned int& end, uint16_t addr, uint16_t& op);
+        uint16_t fetch(unsigned int lane, uint16_t addr) const;
+        // Runs op on the group's lanes, which are all in first..end-1, and
+        // returns whether they still share a pc and have cycles left
+        bool execute(uint16_t op, unsigned int first, unsigned int end);
+        bool executeAVX2(uint16_t op, unsigned int first, unsigned int end);
+        bool executeLanes(uint16_t op, unsigned int first, unsigned int end);
+        void writeRam(unsigned int lane, uint16_t addr, uint8_t value);
+};
+
+#endif
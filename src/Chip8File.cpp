@@ -0,0 +1,54 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include "Chip8.hpp"
+
+// File loading and saving for the frontend and tools, kept out of
+// Chip8.cpp so the core builds without iostreams (see libchip8.h)
+
+void Chip8::loadROM(const std::string fileName)
+{
+    std::ifstream inputFile(fileName, std::ios::binary); 
+    if(inputFile.is_open())
+    {
+        uintmax_t fileSize{std::filesystem::file_size(fileName)};
+        if(fileSize > (RAM_SIZE - RAM_START))
+        {
+            std::cout << "File will not fit";
+            return;
+        }
+        char* fBuffer{new char[fileSize]};
+        inputFile.read(fBuffer, fileSize);
+
+        inputFile.close();
+        loadROM(reinterpret_cast<const uint8_t*>(fBuffer), fileSize);
+
+        delete[] fBuffer;
+    }
+    else
+    {
+        std::cout << "Could not open file";
+    }
+    
+}
+
+bool Chip8::saveState(const std::string& fileName) const
+{
+    uint8_t saved[STATE_FILE_SIZE];
+    saveState(saved, sizeof(saved));
+
+    std::ofstream out(fileName, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(saved), sizeof(saved));
+    return out.good();
+}
+
+bool Chip8::loadState(const std::string& fileName)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    uint8_t saved[STATE_FILE_SIZE];
+    if(!in.read(reinterpret_cast<char*>(saved), sizeof(saved)))
+    {
+        return false;
+    }
+    return loadState(saved, sizeof(saved));
+}
@@ -0,0 +1,188 @@
+#include <new>
+#include <atomic>
+#include "EnvPool.hpp"
+
+// observations() hands out the buffer as one byte array
+static_assert(OBSERVATION_BYTES % 64 == 0, "observations have to fill whole cache lines");
+
+EnvPool::EnvPool(unsigned int count, unsigned int threads) :
+    count(count), pool(threads), observationBuffer(count), rewardBuffer(count), doneBuffer(count)
+{
+    maxFrames = 0;
+    baseSeed = 0;
+
+    // the same power on state a Chip8 starts from
+    Chip8 power;
+    power.saveState(start);
+
+    // a few runs per worker, enough to even out with stealing
+    grain = std::max<size_t>(count / (pool.size() * 4), 1);
+
+    // first touch from the thread that will mostly step each one. An
+    // exception can't leave a worker, so running out of memory is passed
+    // back and thrown here.
+    envs.resize(count);
+    std::atomic<bool> outOfMemory{false};
+    pool.run(count, [this, &outOfMemory](size_t index, unsigned int)
+    {
+        envs[index].reset(new(std::nothrow) Env);
+        if(!envs[index])
+        {
+            outOfMemory = true;
+        }
+    }, grain);
+    if(outOfMemory)
+    {
+        throw std::bad_alloc();
+    }
+    reset();
+}
+
+bool EnvPool::loadROM(const uint8_t* data, size_t size)
+{
+    if(size > (RAM_SIZE - RAM_START))
+    {
+        return false;
+    }
+    Chip8 power;
+    power.loadROM(data, size);
+    power.saveState(start);
+    reset();
+    return true;
+}
+
+void EnvPool::seed(uint32_t seed)
+{
+    baseSeed = seed;
+}
+
+bool EnvPool::addReward(const RewardTerm& term)
+{
+    if(term.bytes == 0 || term.bytes > 8)
+    {
+        return false;
+    }
+    rewardTerms.push_back(term);
+    return true;
+}
+
+void EnvPool::addDone(const DoneCondition& condition)
+{
+    doneConditions.push_back(condition);
+}
+
+unsigned int EnvPool::size() const
+{
+    return count;
+}
+
+const uint8_t* EnvPool::observations() const
+{
+    return reinterpret_cast<const uint8_t*>(observationBuffer.data());
+}
+
+const float* EnvPool::rewards() const
+{
+    return rewardBuffer.data();
+}
+
+const uint8_t* EnvPool::dones() const
+{
+    return doneBuffer.data();
+}
+
+const Chip8& EnvPool::env(unsigned int index) const
+{
+    return envs[index]->chip;
+}
+
+void EnvPool::reset()
+{
+    pool.run(count, [this](size_t index, unsigned int)
+    {
+        envs[index]->episode = 0;
+        resetEnv(index);
+        envs[index]->chip.packDisplay(observationBuffer[index].pixels);
+        rewardBuffer[index] = 0;
+        doneBuffer[index] = 0;
+    }, grain);
+}
+
+void EnvPool::step(const uint16_t* actions, unsigned int frameSkip)
+{
+    frameSkip = std::max(frameSkip, 1u);
+    pool.run(count, [this, actions, frameSkip](size_t index, unsigned int)
+    {
+        stepEnv(index, actions[index], frameSkip);
+    }, grain);
+}
+
+double EnvPool::readScore(const Chip8& chip) const
+{
+    double score{0};
+    for(const RewardTerm& term : rewardTerms)
+    {
+        uint64_t value{0};
+        for(unsigned int byte{0}; byte < term.bytes; byte++)
+        {
+            uint8_t data{chip.ram[(term.address + byte) & 0xFFF]};
+            value = term.digits ? value * 10 + data : value << 8 | data;
+        }
+        score += term.weight * (double)value;
+    }
+    return score;
+}
+
+void EnvPool::resetEnv(unsigned int index)
+{
+    Env& env{*envs[index]};
+    env.chip.loadState(start);
+    env.chip.seedRandom(baseSeed + index + env.episode * count);
+    env.cycleRemainder = 0;
+    env.timerRemainder = 0;
+    env.frames = 0;
+    env.score = readScore(env.chip);
+    env.over = false;
+}
+
+void EnvPool::stepEnv(unsigned int index, uint16_t action, unsigned int frameSkip)
+{
+    Env& env{*envs[index]};
+    if(env.over)
+    {
+        env.episode++;
+        resetEnv(index);
+    }
+    env.chip.setKeys(action);
+
+    uint8_t done{0};
+    for(unsigned int frame{0}; frame < frameSkip && done == 0; frame++)
+    {
+        env.chip.runFrame(env.cycleRemainder, env.timerRemainder);
+        env.frames++;
+
+        for(const DoneCondition& condition : doneConditions)
+        {
+            if((env.chip.ram[condition.address & 0xFFF] & condition.mask) == condition.value)
+            {
+                done |= DONE_TERMINATED;
+            }
+        }
+        if(STRICT_MEMORY && env.chip.trapped())
+        {
+            done |= DONE_TRAPPED;
+        }
+        if(maxFrames != 0 && env.frames >= maxFrames)
+        {
+            done |= DONE_TRUNCATED;
+        }
+    }
+
+    // the score only has to be read at the end, the deltas between add up to this
+    double score{readScore(env.chip)};
+    rewardBuffer[index] = (float)(score - env.score);
+    env.score = score;
+    doneBuffer[index] = done;
+    env.over = done != 0;
+    env.chip.packDisplay(observationBuffer[index].pixels);
+}
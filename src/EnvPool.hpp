@@ -0,0 +1,108 @@
+#ifndef ENVPOOL_H
+#define ENVPOOL_H
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include "Chip8.hpp"
+#include "WorkPool.hpp"
+
+#define OBSERVATION_BYTES (DISPLAY_SIZE / 8) // one packed display
+
+// Done flags
+#define DONE_TERMINATED 0x1 // a done condition held
+#define DONE_TRUNCATED 0x2  // the episode ran maxFrames frames
+#define DONE_TRAPPED 0x4    // the strict memory model stopped the machine
+
+/*
+EnvPool runs many copies of one ROM as reinforcement learning environments
+step() gives every environment its action (a keypad mask, held for the
+whole step), runs frameSkip frames on each and leaves the results in
+buffers allocated once up front, laid out environment after environment:
+    observations: the display packed 1 bit per pixel, OBSERVATION_BYTES each
+    rewards: the change in the RAM score (see RewardTerm) over the step
+    dones: DONE_* flags
+The buffers never move, so callers can keep views of them (numpy arrays
+over the libchip8 pointers, say) and read each step's results in place.
+Environments are split over a WorkPool in contiguous runs, each one's
+observation on cache lines of its own. An environment that finishes an
+episode reports its last frame and starts the next episode at its next
+step. Frames are the ones a FixedStep Scheduler runs, and episode k of
+environment i is seeded with seed + i + k * size(), so episode 0 of
+environment i ends up where chip8-headless --seed seed+i does.
+*/
+class EnvPool
+{
+    public:
+        // A score kept in RAM: bytes bytes at address, most significant
+        // first, or one decimal digit per byte as FX33 stores them
+        struct RewardTerm
+        {
+            uint16_t address;
+            uint8_t bytes; // 1 to 8
+            bool digits;
+            float weight;
+        };
+
+        // Ends the episode once (ram[address] & mask) == value
+        struct DoneCondition
+        {
+            uint16_t address;
+            uint8_t mask;
+            uint8_t value;
+        };
+
+        uint32_t maxFrames; // frames per episode, 0 for no limit
+
+        EnvPool(unsigned int count, unsigned int threads = 0); // 0 for one thread per hardware thread
+
+        bool loadROM(const uint8_t* data, size_t size); // false if it won't fit
+        void seed(uint32_t seed);
+        bool addReward(const RewardTerm& term);
+        void addDone(const DoneCondition& condition);
+
+        void reset(); // every environment to the start of a new episode
+        void step(const uint16_t* actions, unsigned int frameSkip);
+
+        unsigned int size() const;
+        const uint8_t* observations() const;
+        const float* rewards() const;
+        const uint8_t* dones() const;
+        const Chip8& env(unsigned int index) const;
+
+    private:
+        struct alignas(64) Env
+        {
+            Chip8 chip;
+            unsigned int cycleRemainder;
+            unsigned int timerRemainder;
+            uint32_t episode;
+            uint32_t frames;  // into this episode
+            double score;     // reward terms' sum at the last read
+            bool over;        // reset before the next step
+        };
+
+        struct alignas(64) Observation
+        {
+            uint8_t pixels[OBSERVATION_BYTES];
+        };
+
+        unsigned int count;
+        uint32_t baseSeed;
+        Chip8State start; // power on with the ROM loaded
+        std::vector<RewardTerm> rewardTerms;
+        std::vector<DoneCondition> doneConditions;
+
+        WorkPool pool;
+        size_t grain;
+        std::vector<std::unique_ptr<Env>> envs;
+        std::vector<Observation> observationBuffer;
+        std::vector<float> rewardBuffer;
+        std::vector<uint8_t> doneBuffer;
+
+        double readScore(const Chip8& chip) const;
+        void resetEnv(unsigned int index);
+        void stepEnv(unsigned int index, uint16_t action, unsigned int frameSkip);
+};
+
+#endif
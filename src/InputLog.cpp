@@ -0,0 +1,150 @@
+#include <fstream>
+#include <cstring>
+#include "InputLog.hpp"
+
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_HEADER 24
+
+InputLog::InputLog()
+{
+    clear();
+}
+
+void InputLog::clear()
+{
+    seed = 0;
+    endCycle = 0;
+    records.clear();
+    cursor = 0;
+}
+
+void InputLog::record(uint64_t cycle, uint16_t keys)
+{
+    // the keypad starts with nothing held
+    uint16_t last{records.empty() ? (uint16_t)0 : records.back().keys};
+    if(keys != last)
+    {
+        records.push_back({cycle, keys});
+    }
+    endCycle = cycle;
+}
+
+bool InputLog::next(uint64_t cycle, uint16_t& keys)
+{
+    if(cursor >= records.size() || records[cursor].cycle > cycle)
+    {
+        return false;
+    }
+    keys = records[cursor++].keys;
+    return true;
+}
+
+void InputLog::rewind()
+{
+    cursor = 0;
+}
+
+size_t InputLog::size() const
+{
+    return records.size();
+}
+
+static void putLE(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for(int i{0}; i < bytes; i++)
+    {
+        out.push_back((value >> (8*i)) & 0xFF);
+    }
+}
+
+static uint64_t getLE(const uint8_t* in, int bytes)
+{
+    uint64_t value{0};
+    for(int i{0}; i < bytes; i++)
+    {
+        value |= (uint64_t)in[i] << (8*i);
+    }
+    return value;
+}
+
+bool InputLog::save(const std::string& fileName) const
+{
+    std::vector<uint8_t> out{'C', '8', 'I', 'N', INPUT_LOG_VERSION, 0, 0, 0};
+    putLE(out, seed, 4);
+    putLE(out, endCycle, 8);
+    putLE(out, records.size(), 4);
+
+    uint64_t previous{0};
+    for(const Record& record : records)
+    {
+        // seven bits at a time, high bit set while more follow
+        uint64_t delta{record.cycle - previous};
+        do
+        {
+            out.push_back((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0));
+            delta >>= 7;
+        } while(delta);
+        putLE(out, record.keys, 2);
+        previous = record.cycle;
+    }
+
+    std::ofstream file(fileName, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+    return file.good();
+}
+
+bool InputLog::load(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    // read() rather than istreambuf_iterator, which throws on a directory
+    std::vector<uint8_t> in;
+    size_t size{0};
+    do
+    {
+        in.resize(size + 0x10000);
+        file.read(reinterpret_cast<char*>(in.data() + size), in.size() - size);
+        size += file.gcount();
+    } while(file.good());
+    in.resize(size);
+    if(file.bad() || in.size() < INPUT_LOG_HEADER || memcmp(in.data(), "C8IN", 4) != 0 || in[4] != INPUT_LOG_VERSION)
+    {
+        return false;
+    }
+
+    clear();
+    seed = getLE(&in[8], 4);
+    endCycle = getLE(&in[12], 8);
+    uint32_t count = getLE(&in[20], 4);
+
+    size_t pos{INPUT_LOG_HEADER};
+    uint64_t cycle{0};
+    for(uint32_t i{0}; i < count; i++)
+    {
+        uint64_t delta{0};
+        int shift{0};
+        do
+        {
+            if(pos >= in.size() || shift > 63)
+            {
+                clear();
+                return false;
+            }
+            delta |= (uint64_t)(in[pos] & 0x7F) << shift;
+            shift += 7;
+        } while(in[pos++] & 0x80);
+
+        if(pos + 2 > in.size())
+        {
+            clear();
+            return false;
+        }
+        cycle += delta;
+        records.push_back({cycle, (uint16_t)getLE(&in[pos], 2)});
+        pos += 2;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+InputLog is a keypad recording that replays exactly
+Each record is the keypad bitmask from the cycle it took effect on, with
+cycles counted in Scheduler virtual time so they land on the same frame
+boundary in every run. Together with the CXNN seed in the header that is
+everything a run depends on.
+
+File layout, little endian
+    "C8IN", version (1 byte), 3 reserved bytes
+    seed (4 bytes), end cycle (8 bytes), record count (4 bytes)
+    per record: cycles since the previous record as a LEB128 varint,
+    then the keypad bitmask (2 bytes)
+*/
+class InputLog
+{
+    public:
+        uint32_t seed;      // CXNN seed the run started with
+        uint64_t endCycle;  // where the recorded session stopped
+
+        InputLog();
+
+        void clear();
+        // Appends a record if the keys differ from the last one
+        void record(uint64_t cycle, uint16_t keys);
+
+        // Replay: true and the keys of the next record due by cycle, call
+        // until it returns false
+        bool next(uint64_t cycle, uint16_t& keys);
+        void rewind();
+        size_t size() const;
+
+        bool save(const std::string& fileName) const;
+        bool load(const std::string& fileName);
+
+    private:
+        struct Record
+        {
+            uint64_t cycle;
+            uint16_t keys;
+        };
+
+        std::vector<Record> records;
+        size_t cursor; // next record to replay
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include <thread>
+#include <algorithm>
+#include "Pacer.hpp"
+
+#define NS_PER_SECOND 1000000000LL
+#define MIN_SPIN_MARGIN 200000LL // 0.2 ms
+#define MAX_LATE_FRAMES 4        // further behind than this, give up catching up
+
+Pacer::Pacer(uint64_t rateHz) : rateHz(rateHz)
+{
+    reset();
+}
+
+void Pacer::reset()
+{
+    start = Clock::now();
+    frame = 0;
+    spinMargin = 1000000;
+    totalJitter = 0;
+    stats = Stats{0, 0, 0, 0, 0};
+}
+
+int64_t Pacer::sinceStart(Clock::time_point time) const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - start).count();
+}
+
+int64_t Pacer::deadline() const
+{
+    return frame * NS_PER_SECOND / rateHz;
+}
+
+void Pacer::wait()
+{
+    frame++;
+    int64_t due{deadline()};
+    int64_t now{sinceStart(Clock::now())};
+
+    if(now >= due)
+    {
+        stats.lateFrames++;
+
+        // way behind (debugger, window drag), restart the schedule from now
+        if(now - due > MAX_LATE_FRAMES * NS_PER_SECOND / (int64_t)rateHz)
+        {
+            start = Clock::now();
+            frame = 0;
+        }
+    }
+    else
+    {
+        // sleep for most of it, the OS may wake us late
+        if(due - now > spinMargin)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - spinMargin));
+            int64_t woke{sinceStart(Clock::now())};
+            if(woke > due)
+            {
+                // overslept, keep a bigger margin from now on
+                spinMargin = std::min<int64_t>(spinMargin + (woke - due), NS_PER_SECOND / rateHz);
+            }
+            else
+            {
+                spinMargin = std::max<int64_t>(spinMargin - spinMargin / 64, MIN_SPIN_MARGIN);
+            }
+        }
+
+        // spin for the remainder
+        while(sinceStart(Clock::now()) < due)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    int64_t drift{sinceStart(Clock::now()) - due};
+    if(frame == 0)
+    {
+        drift = 0; // schedule was just restarted
+    }
+    stats.frames++;
+    stats.lastDrift = drift;
+    stats.maxDrift = std::max(stats.maxDrift, drift);
+    totalJitter += std::abs(drift);
+    stats.meanJitter = (double)totalJitter / stats.frames;
+}
+
+const Pacer::Stats& Pacer::getStats() const
+{
+    return stats;
+}
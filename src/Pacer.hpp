@@ -0,0 +1,49 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <cstdint>
+#include <chrono>
+
+/*
+Pacer keeps a loop running at a fixed rate
+All times are integer nanoseconds. Deadlines are computed from the start
+time and the frame count so rounding never accumulates, and each wait is
+a coarse sleep followed by a short spin so the thread is idle between
+frames without overshooting the deadline.
+*/
+class Pacer
+{
+    public:
+        struct Stats
+        {
+            uint64_t frames;     // waits completed
+            uint64_t lateFrames; // deadline already passed when wait() was called
+            int64_t lastDrift;   // ns woken after the deadline on the last wait
+            int64_t maxDrift;
+            double meanJitter;   // mean absolute drift in ns
+        };
+
+        Pacer(uint64_t rateHz);
+        void reset();
+
+        // Blocks until the next frame is due
+        void wait();
+
+        const Stats& getStats() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        uint64_t rateHz;
+        Clock::time_point start;
+        uint64_t frame;
+
+        int64_t spinMargin; // ns left to spin after sleeping, adapts to the OS
+        int64_t totalJitter;
+        Stats stats;
+
+        int64_t sinceStart(Clock::time_point time) const;
+        int64_t deadline() const;
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include <cstring>
+#include <algorithm>
+#include "Present.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PRESENT_X86 1
+#include <immintrin.h>
+#endif
+
+// Byte k of a row word holds pixels 8k to 8k+7, most significant bit first
+static inline uint8_t sourceByte(uint64_t word, int k)
+{
+    return (word >> (56 - 8*k)) & 0xFF;
+}
+
+static void expandScalar32(const uint64_t* row, int words, uint32_t off, uint32_t on, uint32_t* out)
+{
+    for(int w{0}; w < words; w++)
+    {
+        for(int bit{63}; bit >= 0; bit--)
+        {
+            *out++ = (row[w] >> bit) & 0x1 ? on : off;
+        }
+    }
+}
+
+static void expandScalar8(const uint64_t* row, int words, uint8_t off, uint8_t on, uint8_t* out)
+{
+    for(int w{0}; w < words; w++)
+    {
+        for(int bit{63}; bit >= 0; bit--)
+        {
+            *out++ = (row[w] >> bit) & 0x1 ? on : off;
+        }
+    }
+}
+
+#ifdef PRESENT_X86
+
+// 4 pixels per compare, two compares per source byte
+__attribute__((target("sse2")))
+static void expandSSE2_32(const uint64_t* row, int words, uint32_t off, uint32_t on, uint32_t* out)
+{
+    const __m128i bitsHi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+    const __m128i bitsLo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+    const __m128i onVec = _mm_set1_epi32(on);
+    const __m128i offVec = _mm_set1_epi32(off);
+
+    for(int w{0}; w < words; w++)
+    {
+        for(int k{0}; k < 8; k++)
+        {
+            __m128i byte = _mm_set1_epi32(sourceByte(row[w], k));
+            __m128i maskHi = _mm_cmpeq_epi32(_mm_and_si128(byte, bitsHi), bitsHi);
+            __m128i maskLo = _mm_cmpeq_epi32(_mm_and_si128(byte, bitsLo), bitsLo);
+            _mm_storeu_si128((__m128i*)out, _mm_or_si128(_mm_and_si128(maskHi, onVec), _mm_andnot_si128(maskHi, offVec)));
+            _mm_storeu_si128((__m128i*)(out + 4), _mm_or_si128(_mm_and_si128(maskLo, onVec), _mm_andnot_si128(maskLo, offVec)));
+            out += 8;
+        }
+    }
+}
+
+// 16 pixels (two source bytes) per compare
+__attribute__((target("sse2")))
+static void expandSSE2_8(const uint64_t* row, int words, uint8_t off, uint8_t on, uint8_t* out)
+{
+    const __m128i bits = _mm_set1_epi64x(0x0102040810204080);
+    const __m128i onVec = _mm_set1_epi8(on);
+    const __m128i offVec = _mm_set1_epi8(off);
+
+    for(int w{0}; w < words; w++)
+    {
+        for(int k{0}; k < 8; k += 2)
+        {
+            __m128i bytes = _mm_set_epi64x(sourceByte(row[w], k + 1) * 0x0101010101010101,
+                                           sourceByte(row[w], k) * 0x0101010101010101);
+            __m128i mask = _mm_cmpeq_epi8(_mm_and_si128(bytes, bits), bits);
+            _mm_storeu_si128((__m128i*)out, _mm_or_si128(_mm_and_si128(mask, onVec), _mm_andnot_si128(mask, offVec)));
+            out += 16;
+        }
+    }
+}
+
+// 8 pixels (one source byte) per compare
+__attribute__((target("avx2")))
+static void expandAVX2_32(const uint64_t* row, int words, uint32_t off, uint32_t on, uint32_t* out)
+{
+    const __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i onVec = _mm256_set1_epi32(on);
+    const __m256i offVec = _mm256_set1_epi32(off);
+
+    for(int w{0}; w < words; w++)
+    {
+        for(int k{0}; k < 8; k++)
+        {
+            __m256i byte = _mm256_set1_epi32(sourceByte(row[w], k));
+            __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+            _mm256_storeu_si256((__m256i*)out, _mm256_blendv_epi8(offVec, onVec, mask));
+            out += 8;
+        }
+    }
+}
+
+// 32 pixels (four source bytes) per compare
+__attribute__((target("avx2")))
+static void expandAVX2_8(const uint64_t* row, int words, uint8_t off, uint8_t on, uint8_t* out)
+{
+    const __m256i bits = _mm256_set1_epi64x(0x0102040810204080);
+    const __m256i onVec = _mm256_set1_epi8(on);
+    const __m256i offVec = _mm256_set1_epi8(off);
+
+    for(int w{0}; w < words; w++)
+    {
+        for(int k{0}; k < 8; k += 4)
+        {
+            __m256i bytes = _mm256_set_epi64x(sourceByte(row[w], k + 3) * 0x0101010101010101,
+                                              sourceByte(row[w], k + 2) * 0x0101010101010101,
+                                              sourceByte(row[w], k + 1) * 0x0101010101010101,
+                                              sourceByte(row[w], k) * 0x0101010101010101);
+            __m256i mask = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits);
+            _mm256_storeu_si256((__m256i*)out, _mm256_blendv_epi8(offVec, onVec, mask));
+            out += 32;
+        }
+    }
+}
+
+#endif
+
+// 0xRRGGBB to RRRGGGBB
+static uint8_t toRGB332(uint32_t colour)
+{
+    return ((colour >> 16) & 0xE0) | ((colour >> 11) & 0x1C) | ((colour >> 6) & 0x03);
+}
+
+Presenter::Presenter(int srcWidth, int srcHeight, int scale, Format format)
+    : srcWidth(srcWidth), srcHeight(srcHeight), scale(scale), format(format)
+{
+    int bytesPerPixel{format == Format::ARGB8888 ? 4 : 1};
+    pixels.resize((size_t)srcWidth * scale * srcHeight * scale * bytesPerPixel);
+    line.resize((size_t)srcWidth * bytesPerPixel);
+
+    kernel = bestKernel();
+    setPalette(0x000000, 0xFFFFFF);
+}
+
+void Presenter::setPalette(uint32_t offColour, uint32_t onColour)
+{
+    if(format == Format::ARGB8888)
+    {
+        offPixel = 0xFF000000 | offColour;
+        onPixel = 0xFF000000 | onColour;
+    }
+    else
+    {
+        offPixel = toRGB332(offColour);
+        onPixel = toRGB332(onColour);
+    }
+}
+
+void Presenter::setKernel(Kernel kernel)
+{
+    this->kernel = std::min(kernel, bestKernel());
+}
+
+Presenter::Kernel Presenter::getKernel() const
+{
+    return kernel;
+}
+
+Presenter::Kernel Presenter::bestKernel()
+{
+#ifdef PRESENT_X86
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return Kernel::AVX2;
+    }
+    if(__builtin_cpu_supports("sse2"))
+    {
+        return Kernel::SSE2;
+    }
+#endif
+    return Kernel::Scalar;
+}
+
+int Presenter::width() const
+{
+    return srcWidth * scale;
+}
+
+int Presenter::height() const
+{
+    return srcHeight * scale;
+}
+
+int Presenter::pitch() const
+{
+    return width() * (format == Format::ARGB8888 ? 4 : 1);
+}
+
+const void* Presenter::present(const uint64_t* rows)
+{
+    return present(rows, 0, srcHeight);
+}
+
+const void* Presenter::present(const uint64_t* rows, int firstRow, int rowCount)
+{
+    int words{srcWidth / 64};
+    for(int row{firstRow}; row < firstRow + rowCount; row++)
+    {
+        expandLine(rows + row*words);
+
+        // first copy of the row gets the horizontal scaling, the rest are copies
+        uint8_t* out = pixels.data() + (size_t)row * scale * pitch();
+        scaleLine(out);
+        for(int copy{1}; copy < scale; copy++)
+        {
+            memcpy(out + copy*pitch(), out, pitch());
+        }
+    }
+    return pixels.data();
+}
+
+void Presenter::expandLine(const uint64_t* row)
+{
+    int words{srcWidth / 64};
+    uint32_t* out32 = reinterpret_cast<uint32_t*>(line.data());
+
+    switch(kernel)
+    {
+#ifdef PRESENT_X86
+        case Kernel::AVX2:
+            if(format == Format::ARGB8888)
+            {
+                expandAVX2_32(row, words, offPixel, onPixel, out32);
+            }
+            else
+            {
+                expandAVX2_8(row, words, offPixel, onPixel, line.data());
+            }
+            return;
+        case Kernel::SSE2:
+            if(format == Format::ARGB8888)
+            {
+                expandSSE2_32(row, words, offPixel, onPixel, out32);
+            }
+            else
+            {
+                expandSSE2_8(row, words, offPixel, onPixel, line.data());
+            }
+            return;
+#endif
+        default:
+            if(format == Format::ARGB8888)
+            {
+                expandScalar32(row, words, offPixel, onPixel, out32);
+            }
+            else
+            {
+                expandScalar8(row, words, offPixel, onPixel, line.data());
+            }
+            return;
+    }
+}
+
+void Presenter::scaleLine(uint8_t* out)
+{
+    if(scale == 1)
+    {
+        memcpy(out, line.data(), line.size());
+        return;
+    }
+
+    if(format == Format::ARGB8888)
+    {
+        const uint32_t* in32 = reinterpret_cast<const uint32_t*>(line.data());
+        uint32_t* out32 = reinterpret_cast<uint32_t*>(out);
+        for(int x{0}; x < srcWidth; x++)
+        {
+            std::fill_n(out32 + x*scale, scale, in32[x]);
+        }
+    }
+    else
+    {
+        for(int x{0}; x < srcWidth; x++)
+        {
+            memset(out + x*scale, line[x], scale);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef PRESENT_H
+#define PRESENT_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+Presenter turns a 1 bit per pixel framebuffer (rows of uint64_t words, most
+significant bit first, like Chip8::display) into texture pixels
+    ARGB8888: one uint32_t per pixel
+    RGB332: one byte per pixel
+Every source pixel becomes a scale x scale square using a two colour
+palette. The expansion runs with AVX2 or SSE2 when the CPU has them and a
+plain C++ loop otherwise.
+*/
+class Presenter
+{
+    public:
+        enum class Format { ARGB8888, RGB332 };
+        enum class Kernel { Scalar, SSE2, AVX2 };
+
+        Presenter(int srcWidth, int srcHeight, int scale, Format format);
+
+        // Colours are given as 0xRRGGBB
+        void setPalette(uint32_t offColour, uint32_t onColour);
+        void setKernel(Kernel kernel); // falls back if the CPU lacks it
+        Kernel getKernel() const;
+
+        // Expands the framebuffer, result stays valid until the next call
+        const void* present(const uint64_t* rows);
+        const void* present(const uint64_t* rows, int firstRow, int rowCount);
+
+        int width() const;
+        int height() const;
+        int pitch() const; // bytes per output row
+
+        static Kernel bestKernel();
+
+    private:
+        int srcWidth;
+        int srcHeight;
+        int scale;
+        Format format;
+        Kernel kernel;
+
+        uint32_t offPixel;
+        uint32_t onPixel;
+
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> line; // one unscaled row
+
+        void expandLine(const uint64_t* row);
+        void scaleLine(uint8_t* out);
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "Rewind.hpp"
+
+#define STATE_WORDS (sizeof(Chip8State) / 8)
+static_assert(sizeof(Chip8State) % 8 == 0, "deltas work on 8 byte words");
+
+static uint8_t* putVarint(uint8_t* out, uint32_t value)
+{
+    while(value > 0x7F)
+    {
+        *out++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+static const uint8_t* getVarint(const uint8_t* in, uint32_t& value)
+{
+    value = 0;
+    int shift{0};
+    do
+    {
+        value |= (uint32_t)(*in & 0x7F) << shift;
+        shift += 7;
+    } while(*in++ & 0x80);
+    return in;
+}
+
+// state XOR keyframe as (zero words, literal words, literals) runs
+static uint32_t encodeDelta(const uint8_t* state, const uint8_t* keyframe, uint8_t* out)
+{
+    uint8_t* start{out};
+    size_t word{0};
+    while(word < STATE_WORDS)
+    {
+        uint64_t a, b;
+        size_t zeros{word};
+        for(; zeros < STATE_WORDS; zeros++)
+        {
+            memcpy(&a, state + 8*zeros, 8);
+            memcpy(&b, keyframe + 8*zeros, 8);
+            if(a != b)
+            {
+                break;
+            }
+        }
+        size_t literals{zeros};
+        for(; literals < STATE_WORDS; literals++)
+        {
+            memcpy(&a, state + 8*literals, 8);
+            memcpy(&b, keyframe + 8*literals, 8);
+            if(a == b)
+            {
+                break;
+            }
+        }
+
+        out = putVarint(out, zeros - word);
+        out = putVarint(out, literals - zeros);
+        for(size_t i{zeros}; i < literals; i++)
+        {
+            memcpy(&a, state + 8*i, 8);
+            memcpy(&b, keyframe + 8*i, 8);
+            a ^= b;
+            memcpy(out, &a, 8);
+            out += 8;
+        }
+        word = literals;
+    }
+    return out - start;
+}
+
+// out already holds the keyframe
+static void applyDelta(const uint8_t* in, uint32_t size, uint8_t* out)
+{
+    const uint8_t* end{in + size};
+    size_t word{0};
+    while(in < end)
+    {
+        uint32_t zeros, literals;
+        in = getVarint(in, zeros);
+        in = getVarint(in, literals);
+        word += zeros;
+        for(uint32_t i{0}; i < literals; i++, word++)
+        {
+            uint64_t a, b;
+            memcpy(&a, out + 8*word, 8);
+            memcpy(&b, in, 8);
+            a ^= b;
+            memcpy(out + 8*word, &a, 8);
+            in += 8;
+        }
+    }
+}
+
+Rewind::Rewind(unsigned int maxFrames, unsigned int keyInterval, size_t arenaBytes)
+    : maxFrames(maxFrames > 0 ? maxFrames : 1), keyInterval(keyInterval > 0 ? keyInterval : 1)
+{
+    arena.resize(std::max(arenaBytes, sizeof(Chip8State)));
+    entries.resize(this->maxFrames);
+    // one varint pair per literal word at worst
+    scratch.resize(STATE_WORDS * 12 + 16);
+    clear();
+}
+
+void Rewind::clear()
+{
+    oldest = 0;
+    newest = 0;
+    head = 0;
+}
+
+Rewind::Entry& Rewind::entry(uint64_t seq)
+{
+    return entries[seq % maxFrames];
+}
+
+const Rewind::Entry& Rewind::entry(uint64_t seq) const
+{
+    return entries[seq % maxFrames];
+}
+
+void Rewind::dropOldest()
+{
+    // deltas can't be decoded without their keyframe, they go with it
+    uint64_t keyframe{entry(oldest).keyframe};
+    oldest++;
+    while(oldest < newest && entry(oldest).keyframe == keyframe)
+    {
+        oldest++;
+    }
+}
+
+uint8_t* Rewind::reserve(uint32_t size)
+{
+    // frames are written in a loop around the arena; those at or past head
+    // are from the previous lap and are always the oldest ones
+    if(head + size > arena.size())
+    {
+        while(oldest < newest && entry(oldest).offset >= head)
+        {
+            dropOldest();
+        }
+        head = 0;
+    }
+    while(oldest < newest && entry(oldest).offset >= head && entry(oldest).offset < head + size)
+    {
+        dropOldest();
+    }
+
+    uint8_t* out{arena.data() + head};
+    head += size;
+    return out;
+}
+
+void Rewind::push(const Chip8State& state)
+{
+    if(newest - oldest >= maxFrames)
+    {
+        dropOldest();
+    }
+
+    const uint8_t* bytes{reinterpret_cast<const uint8_t*>(&state)};
+    uint64_t keyframe{newest};
+    uint32_t size{sizeof(Chip8State)};
+    if(oldest < newest && newest - entry(newest - 1).keyframe < keyInterval)
+    {
+        keyframe = entry(newest - 1).keyframe;
+        size = encodeDelta(bytes, arena.data() + entry(keyframe).offset, scratch.data());
+    }
+
+    // a delta no smaller than the state isn't worth its keyframe dependency
+    if(size >= sizeof(Chip8State))
+    {
+        keyframe = newest;
+        size = sizeof(Chip8State);
+    }
+
+    uint32_t offset{(uint32_t)(reserve(size) - arena.data())};
+    if(keyframe < oldest)
+    {
+        // the arena is so small making room dropped our own keyframe
+        head = offset;
+        keyframe = newest;
+        size = sizeof(Chip8State);
+        offset = reserve(size) - arena.data();
+    }
+
+    memcpy(arena.data() + offset, keyframe == newest ? bytes : scratch.data(), size);
+    entry(newest) = {offset, size, keyframe};
+    newest++;
+}
+
+bool Rewind::step(Chip8State& out)
+{
+    if(oldest == newest)
+    {
+        return false;
+    }
+    newest--;
+
+    const Entry& frame{entry(newest)};
+    memcpy(&out, arena.data() + entry(frame.keyframe).offset, sizeof(Chip8State));
+    if(frame.keyframe != newest)
+    {
+        applyDelta(arena.data() + frame.offset, frame.size, reinterpret_cast<uint8_t*>(&out));
+    }
+
+    // it was the last frame written, its space is free again
+    head = frame.offset;
+    return true;
+}
+
+unsigned int Rewind::size() const
+{
+    return newest - oldest;
+}
+
+Rewind::Stats Rewind::getStats() const
+{
+    Stats stats{newest - oldest, 0, 0, arena.size()};
+    for(uint64_t seq{oldest}; seq < newest; seq++)
+    {
+        stats.bytesUsed += entry(seq).size;
+        stats.keyframes += entry(seq).keyframe == seq;
+    }
+    return stats;
+}
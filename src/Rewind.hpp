@@ -0,0 +1,63 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstdint>
+#include <vector>
+#include "Chip8.hpp"
+
+/*
+Rewind keeps the last frames' Chip8States in a fixed size arena
+Every keyInterval frames a keyframe is stored whole, the frames in between
+are XORed against their keyframe in 8 byte words and stored as a list of
+runs, each a varint count of zero words, a varint count of nonzero words
+and those nonzero words, which for a typical frame is a few dozen bytes.
+A delta no smaller than the state is stored as a keyframe instead.
+Restoring any frame is one keyframe copy plus one delta, whatever its age.
+When the arena or the frame limit fills up the oldest frames are dropped,
+a keyframe taking the frames that depend on it along.
+*/
+class Rewind
+{
+    public:
+        struct Stats
+        {
+            uint64_t frames;      // frames held
+            uint64_t keyframes;
+            uint64_t bytesUsed;   // arena bytes held by live frames
+            uint64_t arenaBytes;
+        };
+
+        Rewind(unsigned int maxFrames = 60*DRAWHZ, unsigned int keyInterval = DRAWHZ,
+               size_t arenaBytes = 4 << 20);
+
+        void clear();
+        void push(const Chip8State& state); // newest frame
+        bool step(Chip8State& out);         // drops the newest frame into out
+        unsigned int size() const;
+        Stats getStats() const;
+
+    private:
+        struct Entry
+        {
+            uint32_t offset; // in arena
+            uint32_t size;
+            uint64_t keyframe; // sequence number of its keyframe, itself for one
+        };
+
+        unsigned int maxFrames;
+        unsigned int keyInterval;
+        std::vector<uint8_t> arena;
+        std::vector<Entry> entries; // ring indexed by sequence number
+        std::vector<uint8_t> scratch; // worst case delta
+
+        uint64_t oldest; // sequence numbers of the live frames, oldest..newest-1
+        uint64_t newest;
+        uint32_t head;   // next free arena byte
+
+        Entry& entry(uint64_t seq);
+        const Entry& entry(uint64_t seq) const;
+        uint8_t* reserve(uint32_t size);
+        void dropOldest();
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include "Scheduler.hpp"
+
+#define NS_PER_SECOND 1000000000ULL
+#define MAX_CATCH_UP 8 // frames run at most per advance() at 1x before dropping time
+
+Scheduler::Scheduler(Chip8& chip) : chip(chip), pacer(DRAWHZ)
+{
+    mode = Mode::RealTime;
+    speedPercent = 100;
+    frames = 0;
+    cycles = 0;
+    cycleRemainder = 0;
+    timerRemainder = 0;
+    replay = nullptr;
+    recording = nullptr;
+    history = nullptr;
+    reset();
+}
+
+void Scheduler::setMode(Mode mode, unsigned int speedPercent)
+{
+    this->mode = mode;
+    this->speedPercent = speedPercent > 0 ? speedPercent : 1;
+    reset();
+}
+
+Scheduler::Mode Scheduler::getMode() const
+{
+    return mode;
+}
+
+void Scheduler::reset()
+{
+    clockStart = Clock::now();
+    framesAtStart = frames;
+    pacer.reset();
+}
+
+int64_t Scheduler::nsSince(Clock::time_point time) const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - time).count();
+}
+
+void Scheduler::setReplay(InputLog* log)
+{
+    replay = log;
+}
+
+void Scheduler::setRecording(InputLog* log)
+{
+    recording = log;
+}
+
+void Scheduler::setRewind(Rewind* history)
+{
+    this->history = history;
+}
+
+unsigned int Scheduler::runFrame()
+{
+    // input only ever changes on a frame boundary
+    uint16_t keys;
+    while(replay && replay->next(virtualCycles(), keys))
+    {
+        chip.setKeys(keys);
+    }
+    if(recording)
+    {
+        recording->record(virtualCycles(), chip.keypad);
+    }
+
+    unsigned int executed{chip.runFrame(cycleRemainder, timerRemainder)};
+
+    frames++;
+    cycles += executed;
+    if(history)
+    {
+        history->push(chip.state());
+    }
+    return executed;
+}
+
+void Scheduler::runAhead(unsigned int count)
+{
+    // copies, so the real frames that follow keep their cadence
+    unsigned int cycles{cycleRemainder};
+    unsigned int timers{timerRemainder};
+    for(unsigned int frame{0}; frame < count; frame++)
+    {
+        chip.runFrame(cycles, timers);
+    }
+}
+
+unsigned int Scheduler::advance()
+{
+    unsigned int ran{0};
+    switch(mode)
+    {
+        case Mode::FixedStep:
+            runFrame();
+            ran = 1;
+            break;
+
+        case Mode::Turbo:
+        {
+            // fill one host frame with emulation
+            Clock::time_point start = Clock::now();
+            do
+            {
+                runFrame();
+                ran++;
+            } while(nsSince(start) < (int64_t)(NS_PER_SECOND / DRAWHZ));
+            break;
+        }
+
+        case Mode::RealTime:
+        case Mode::Speed:
+        {
+            uint64_t elapsed = nsSince(clockStart);
+            uint64_t scale{mode == Mode::Speed ? speedPercent : 100};
+            uint64_t due{framesAtStart + elapsed * DRAWHZ * scale / (NS_PER_SECOND * 100)};
+
+            // a fast forward runs scale/100 frames per host frame anyway,
+            // so the limit grows with it or --speed would top out at 8x
+            uint64_t catchUp{MAX_CATCH_UP * std::max<uint64_t>((scale + 99) / 100, 1)};
+            while(frames < due && ran < catchUp)
+            {
+                runFrame();
+                ran++;
+            }
+
+            // too far behind to catch up, drop the missing time
+            if(frames < due)
+            {
+                clockStart = Clock::now();
+                framesAtStart = frames;
+            }
+            break;
+        }
+    }
+    return ran;
+}
+
+void Scheduler::pace()
+{
+    if(mode != Mode::Turbo)
+    {
+        pacer.wait();
+    }
+}
+
+uint64_t Scheduler::getFrames() const
+{
+    return frames;
+}
+
+uint64_t Scheduler::getCycles() const
+{
+    return cycles;
+}
+
+uint64_t Scheduler::virtualTimeNs() const
+{
+    return frames * NS_PER_SECOND / DRAWHZ;
+}
+
+uint64_t Scheduler::virtualCycles() const
+{
+    return frames * CLOCKHZ / DRAWHZ;
+}
+
+const Pacer::Stats& Scheduler::getPacerStats() const
+{
+    return pacer.getStats();
+}
@@ -0,0 +1,85 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include "Chip8.hpp"
+#include "Pacer.hpp"
+#include "InputLog.hpp"
+#include "Rewind.hpp"
+
+/*
+Scheduler advances a Chip8 in virtual time
+Emulated time only moves in whole frames of CLOCKHZ/DRAWHZ cycles plus the
+60 Hz timer ticks, so a run produces the same frames in every mode; the
+mode only decides how many frames happen per host frame
+    RealTime: follows the wall clock, catching up after a slow host frame
+    Speed: like RealTime with the clock scaled by speedPercent
+    Turbo: as many frames as fit in one host frame, no waiting
+    FixedStep: exactly one frame per host frame, never reads the clock
+Keys from a replayed InputLog are applied, and the keypad recorded, at the
+start of each frame, so a replay is exact whatever the mode. With a Rewind
+attached every frame's end state is pushed to it.
+*/
+class Scheduler
+{
+    public:
+        enum class Mode { RealTime, Speed, Turbo, FixedStep };
+
+        Scheduler(Chip8& chip);
+
+        void setMode(Mode mode, unsigned int speedPercent = 100);
+        Mode getMode() const;
+        void reset(); // restart wall clock tracking, keeps virtual time
+
+        // Runs whatever emulated frames are due, returns how many ran
+        unsigned int advance();
+
+        // Waits until the frontend should present again (not in Turbo)
+        void pace();
+
+        // Runs exactly one emulated frame, returns cycles executed
+        unsigned int runFrame();
+
+        // Runs frames with the current keys but without counting them,
+        // logging them or adding them to the rewind history. For run-ahead,
+        // the caller saves the Chip8State before and restores it after.
+        void runAhead(unsigned int count);
+
+        // Logs stay owned by the caller, nullptr to stop
+        void setReplay(InputLog* log);
+        void setRecording(InputLog* log);
+        void setRewind(Rewind* history);
+
+        uint64_t getFrames() const; // emulated frames so far
+        uint64_t getCycles() const; // instructions executed so far
+        uint64_t virtualTimeNs() const;
+        uint64_t virtualCycles() const; // clock cycles in the frames so far
+        const Pacer::Stats& getPacerStats() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        Chip8& chip;
+        Mode mode;
+        unsigned int speedPercent;
+        Pacer pacer;
+
+        uint64_t frames;
+        uint64_t cycles;
+
+        // CLOCKHZ and DELAYHZ need not divide DRAWHZ, leftovers carry over
+        unsigned int cycleRemainder;
+        unsigned int timerRemainder;
+
+        // wall clock tracking for RealTime and Speed
+        Clock::time_point clockStart;
+        uint64_t framesAtStart;
+
+        InputLog* replay;
+        InputLog* recording;
+        Rewind* history;
+
+        int64_t nsSince(Clock::time_point time) const;
+};
+
+#endif
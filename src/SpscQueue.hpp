@@ -0,0 +1,56 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+Lock-free bounded queue for exactly one producer and one consumer thread
+SIZE must be a power of two, one slot is kept empty to tell full from empty
+*/
+template<typename T, size_t SIZE>
+class SpscQueue
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+    public:
+        SpscQueue() : head(0), tail(0)
+        {
+        }
+
+        // Producer side, false if the queue is full
+        bool push(const T& value)
+        {
+            size_t curTail = tail.load(std::memory_order_relaxed);
+            size_t next = (curTail + 1) & (SIZE - 1);
+            if(next == head.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            items[curTail] = value;
+            tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side, false if the queue is empty
+        bool pop(T& value)
+        {
+            size_t curHead = head.load(std::memory_order_relaxed);
+            if(curHead == tail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            value = items[curHead];
+            head.store((curHead + 1) & (SIZE - 1), std::memory_order_release);
+            return true;
+        }
+
+    private:
+        T items[SIZE];
+
+        // kept on separate cache lines so the two threads don't fight over them
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+};
+
+#endif
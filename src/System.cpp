@@ -1,19 +1,34 @@
+#include <cstdlib>
+#include <iostream>
+#include <random>
 #include "System.hpp"
 
+#define AUDIO_CATCH_UP 8 // frames run at most per pass in Audio mode
+
 System::System(const char *winTitle, int windowWidth, int windowHeight, int texW, int texH)
+    : presenter(texW, texH, 1, Presenter::Format::ARGB8888), scheduler(chipEmu)
 {
     chipEmu = Chip8();
     SDL_InitSubSystem(SDL_INIT_VIDEO);
     
     windowObj = SDL_CreateWindow(winTitle, 50, 50, windowWidth, windowHeight, 0);
     renderer = SDL_CreateRenderer(windowObj, -1, 0);
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB332, SDL_TEXTUREACCESS_STREAMING, texW, texH);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, texW, texH);
 
     shutDown = false;
+    redraw = true;
+    uploadAll = true;
+    memset(shown, 0, sizeof(shown));
+
+    replaying = false;
+    rewinding = false;
+    liveKeys = 0;
+    runAheadFrames = 0;
+    scheduler.setRewind(&history);
+    sync = Sync::Timer;
+    refreshHz = DRAWHZ;
+    frameCredit = 0;
 
-    clockTime = (1/(float)CLOCKHZ)*1000; // ms clock period
-    delayTime = (1/(float)DELAYHZ)*1000;
-    drawTime = (1/(float)DRAWHZ)*1000;
 }
 
 System::~System()
@@ -21,9 +36,54 @@ System::~System()
     SDL_DestroyWindow(windowObj);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyTexture(texture);
+    beeper.close();
     SDL_Quit();
 }
 
+// use SDL scancodes for multiple keyboard layout compatibility
+static int mapKey(SDL_Scancode scancode)
+{
+    switch(scancode)
+    {
+        case SDL_SCANCODE_1:
+            return 0x1;
+        case SDL_SCANCODE_2:
+            return 0x2;
+        case SDL_SCANCODE_3:
+            return 0x3;
+        case SDL_SCANCODE_4:
+            return 0xC;
+        case SDL_SCANCODE_Q:
+            return 0x4;
+        case SDL_SCANCODE_W:
+            return 0x5;
+        case SDL_SCANCODE_E:
+            return 0x6;
+        case SDL_SCANCODE_R:
+            return 0xD;
+        case SDL_SCANCODE_A:
+            return 0x7;
+        case SDL_SCANCODE_S:
+            return 0x8;
+        case SDL_SCANCODE_D:
+            return 0x9;
+        case SDL_SCANCODE_F:
+            return 0xE;
+        case SDL_SCANCODE_Z:
+            return 0xA;
+        case SDL_SCANCODE_X:
+            return 0x0;
+        case SDL_SCANCODE_C:
+            return 0xB;
+        case SDL_SCANCODE_V:
+            return 0xF;
+        case SDL_SCANCODE_BACKSPACE:
+            return KEY_REWIND;
+        default:
+            return -1;
+    }
+}
+
 void System::update()
 {
     SDL_Event event{0};
@@ -37,123 +97,92 @@ void System::update()
                 break;
             }
 
-            case SDL_KEYDOWN:
+            case SDL_WINDOWEVENT:
             {
-                // use SDL scancodes for multiple keyboard layout compatibility
-                switch(event.key.keysym.scancode)
-                {
-                    case SDL_SCANCODE_1:
-                        chipEmu.keypad[0x1] = 1;
-                        break;
-                    case SDL_SCANCODE_2:
-                        chipEmu.keypad[0x2] = 1;
-                        break;
-                    case SDL_SCANCODE_3:
-                        chipEmu.keypad[0x3] = 1;
-                        break;
-                    case SDL_SCANCODE_4:
-                        chipEmu.keypad[0xC] = 1;
-                        break;
-                    case SDL_SCANCODE_Q:
-                        chipEmu.keypad[0x4] = 1;
-                        break;
-                    case SDL_SCANCODE_W:
-                        chipEmu.keypad[0x5] = 1;
-                        break;
-                    case SDL_SCANCODE_E:
-                        chipEmu.keypad[0x6] = 1;
-                        break;
-                    case SDL_SCANCODE_R:
-                        chipEmu.keypad[0xD] = 1;
-                        break;
-                    case SDL_SCANCODE_A:
-                        chipEmu.keypad[0x7] = 1;
-                        break;
-                    case SDL_SCANCODE_S:
-                        chipEmu.keypad[0x8] = 1;
-                        break;
-                    case SDL_SCANCODE_D:
-                        chipEmu.keypad[0x9] = 1;
-                        break;
-                    case SDL_SCANCODE_F:
-                        chipEmu.keypad[0xE] = 1;
-                        break;
-                    case SDL_SCANCODE_Z:
-                        chipEmu.keypad[0xA] = 1;
-                        break;
-                    case SDL_SCANCODE_X:
-                        chipEmu.keypad[0x0] = 1;
-                        break;
-                    case SDL_SCANCODE_C:
-                        chipEmu.keypad[0xB] = 1;
-                        break;
-                    case SDL_SCANCODE_V:
-                        chipEmu.keypad[0xF] = 1;
-                        break;
-                }
+                // window contents may be lost, present again
+                redraw = true;
                 break;
             }
 
+            case SDL_KEYDOWN:
             case SDL_KEYUP:
-                switch(event.key.keysym.scancode)
+            {
+                int key{mapKey(event.key.keysym.scancode)};
+                if(key < 0 || event.key.repeat)
                 {
-                    case SDL_SCANCODE_1:
-                        chipEmu.keypad[0x1] = 0;
-                        break;
-                    case SDL_SCANCODE_2:
-                        chipEmu.keypad[0x2] = 0;
-                        break;
-                    case SDL_SCANCODE_3:
-                        chipEmu.keypad[0x3] = 0;
-                        break;
-                    case SDL_SCANCODE_4:
-                        chipEmu.keypad[0xC] = 0;
-                        break;
-                    case SDL_SCANCODE_Q:
-                        chipEmu.keypad[0x4] = 0;
-                        break;
-                    case SDL_SCANCODE_W:
-                        chipEmu.keypad[0x5] = 0;
-                        break;
-                    case SDL_SCANCODE_E:
-                        chipEmu.keypad[0x6] = 0;
-                        break;
-                    case SDL_SCANCODE_R:
-                        chipEmu.keypad[0xD] = 0;
-                        break;
-                    case SDL_SCANCODE_A:
-                        chipEmu.keypad[0x7] = 0;
-                        break;
-                    case SDL_SCANCODE_S:
-                        chipEmu.keypad[0x8] = 0;
-                        break;
-                    case SDL_SCANCODE_D:
-                        chipEmu.keypad[0x9] = 0;
-                        break;
-                    case SDL_SCANCODE_F:
-                        chipEmu.keypad[0xE] = 0;
-                        break;
-                    case SDL_SCANCODE_Z:
-                        chipEmu.keypad[0xA] = 0;
-                        break;
-                    case SDL_SCANCODE_X:
-                        chipEmu.keypad[0x0] = 0;
-                        break;
-                    case SDL_SCANCODE_C:
-                        chipEmu.keypad[0xB] = 0;
-                        break;
-                    case SDL_SCANCODE_V:
-                        chipEmu.keypad[0xF] = 0;
-                        break;
+                    break;
+                }
+
+                // keys are applied by the emulation thread between frames
+                KeyEvent keyEvent{(uint8_t)key, event.type == SDL_KEYDOWN};
+                while(!inputQueue.push(keyEvent))
+                {
+                    // VSync and Audio have no emulation thread to wait
+                    // for, this is between their frames so apply the keys
+                    // queued so far here. Once shutting down the emulation
+                    // thread may be gone, and the key no longer matters.
+                    if(sync != Sync::Timer)
+                    {
+                        applyInput();
+                    }
+                    else if(shutDown)
+                    {
+                        break;
+                    }
+                    else
+                    {
+                        std::this_thread::yield();
+                    }
                 }
                 break;
+            }
         }
     }
 }
 
-void System::refresh(const void* pixels, int pitch)
+void System::refresh()
 {
-    SDL_UpdateTexture(texture, NULL, pixels, pitch);
+    // newest frame from the emulation thread, if there is one
+    bool fresh{frames.update()};
+    if(fresh || uploadAll)
+    {
+        const Frame& frame = frames.readBuffer();
+
+        // frames in between may have been skipped, so diff against what
+        // is on screen instead of trusting one frame's dirty rows
+        int firstRow{DISPLAY_ROWS};
+        int lastRow{-1};
+        for(int row{0}; row < DISPLAY_ROWS; row++)
+        {
+            if(frame.display[row] != shown[row] || uploadAll)
+            {
+                firstRow = std::min(firstRow, row);
+                lastRow = row;
+                shown[row] = frame.display[row];
+            }
+        }
+        uploadAll = false;
+
+        // only the changed rows get expanded and uploaded
+        if(lastRow >= 0)
+        {
+            int scale{presenter.height() / DISPLAY_ROWS};
+            int rowCount{lastRow - firstRow + 1};
+
+            const uint8_t* pixels = static_cast<const uint8_t*>(presenter.present(shown, firstRow, rowCount));
+            SDL_Rect rows{0, firstRow*scale, presenter.width(), rowCount*scale};
+            SDL_UpdateTexture(texture, &rows, pixels + rows.y*presenter.pitch(), presenter.pitch());
+            redraw = true;
+        }
+    }
+
+    // nothing changed since the last present
+    if(!redraw)
+    {
+        return;
+    }
+    redraw = false;
+
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
@@ -164,44 +193,326 @@ void System::loadSystem(std::string fileName)
     chipEmu.loadROM(fileName);
 }
 
-void System::loop()
+void System::setEngine(Chip8::Engine engine)
+{
+    chipEmu.engine = engine;
+}
+
+void System::setPalette(uint32_t offColour, uint32_t onColour)
+{
+    presenter.setPalette(offColour, onColour);
+    uploadAll = true;
+}
+
+void System::setSpeed(Scheduler::Mode mode, unsigned int speedPercent)
+{
+    scheduler.setMode(mode, speedPercent);
+}
+
+bool System::setSync(Sync sync)
+{
+    // Audio can't run without a device, VSync just stays silent
+    if(sync != Sync::Timer && !beeper.open() && sync == Sync::Audio)
+    {
+        return false;
+    }
+    if(sync == Sync::Timer)
+    {
+        beeper.close();
+    }
+
+    if(SDL_RenderSetVSync(renderer, sync == Sync::VSync) != 0)
+    {
+        beeper.close();
+        return false;
+    }
+
+    if(sync == Sync::VSync)
+    {
+        SDL_DisplayMode mode;
+        refreshHz = DRAWHZ;
+        if(SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(windowObj), &mode) == 0 && mode.refresh_rate > 0)
+        {
+            refreshHz = mode.refresh_rate;
+        }
+        frameCredit = 0;
+    }
+
+    this->sync = sync;
+    return true;
+}
+
+bool System::recordInput(std::string fileName)
+{
+    // a fresh seed, kept in the log so CXNN replays too
+    inputLog.clear();
+    inputLog.seed = std::random_device{}();
+    chipEmu.seedRandom(inputLog.seed);
+
+    recordFile = fileName;
+    replaying = false;
+    scheduler.setReplay(nullptr);
+    scheduler.setRecording(&inputLog);
+    scheduler.setRewind(nullptr);
+    return true;
+}
+
+bool System::replayInput(std::string fileName)
+{
+    if(!inputLog.load(fileName))
+    {
+        return false;
+    }
+    chipEmu.seedRandom(inputLog.seed);
+
+    recordFile.clear();
+    replaying = true;
+    scheduler.setRecording(nullptr);
+    scheduler.setReplay(&inputLog);
+    scheduler.setRewind(nullptr);
+    return true;
+}
+
+void System::applyInput()
 {
+    KeyEvent keyEvent;
+    while(inputQueue.pop(keyEvent))
+    {
+        if(keyEvent.key == KEY_REWIND)
+        {
+            // going back in time would break a recording or replay
+            if(replaying || !recordFile.empty())
+            {
+                continue;
+            }
 
-    auto lastCycle = std::chrono::high_resolution_clock::now();
-    auto lastTimer = std::chrono::high_resolution_clock::now();
-    auto lastDraw = std::chrono::high_resolution_clock::now();
+            // back to real time from wherever rewinding stopped
+            if(rewinding && !keyEvent.pressed)
+            {
+                scheduler.reset();
+            }
+            rewinding = keyEvent.pressed;
+            continue;
+        }
+
+        uint16_t bit = 1 << keyEvent.key;
+        liveKeys = keyEvent.pressed ? liveKeys | bit : liveKeys & ~bit;
+
+        // the scheduler feeds the keys from the log instead
+        if(!replaying)
+        {
+            chipEmu.setKey(keyEvent.key, keyEvent.pressed);
+        }
+    }
+}
+
+void System::stepBack()
+{
+    Chip8State state;
+    if(history.step(state))
+    {
+        chipEmu.loadState(state);
+        // the keypad in the old state is not what is held now
+        chipEmu.setKeys(liveKeys);
+    }
+}
+
+void System::setRunAhead(unsigned int frames)
+{
+    runAheadFrames = frames;
+}
+
+void System::publishFrame()
+{
+    // show where the game will be a few frames on with the keys held now,
+    // then go back so the real frames carry on from the saved state
+    bool ahead{runAheadFrames > 0 && !rewinding};
+    if(ahead)
+    {
+        chipEmu.saveState(aheadState);
+        scheduler.runAhead(runAheadFrames);
+    }
+
+    // hand the display over only when it changed
+    if(chipEmu.displayDirty)
+    {
+        Frame& frame = frames.writeBuffer();
+        memcpy(frame.display, chipEmu.display, sizeof(frame.display));
+        frames.publish();
+        chipEmu.clearDirty();
+    }
+
+    // restoring marks the display dirty again if it differs from the one shown
+    if(ahead)
+    {
+        chipEmu.loadState(aheadState);
+    }
+}
+
+void System::runFrame()
+{
+    if(rewinding)
+    {
+        stepBack();
+    }
+    else
+    {
+        scheduler.runFrame();
+    }
+    beeper.queueFrame(chipEmu.soundTimer > 0, sync == Sync::VSync);
+}
+
+void System::emulate()
+{
+    scheduler.reset();
 
     while(!shutDown)
     {
+        applyInput();
+        if(rewinding)
+        {
+            stepBack();
+        }
+        else
+        {
+            scheduler.advance();
+        }
+        publishFrame();
 
+        // sleep until the next frame is due
+        scheduler.pace();
+    }
+}
+
+void System::loopVSync()
+{
+    scheduler.reset();
+
+    while(!shutDown)
+    {
         update();
+        applyInput();
+
+        // a hidden window may not wait for the vertical blank
+        if(SDL_GetWindowFlags(windowObj) & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN))
+        {
+            runFrame();
+            publishFrame();
+            scheduler.pace();
+            continue;
+        }
+
+        // SDL reports whole Hz, so 59.94 Hz shows up as 59 or 60; close
+        // enough gets exactly one frame per refresh and rate control on the
+        // sound takes up the difference, anything else spreads DRAWHZ frames
+        // over refreshHz presents
+        if(std::abs(refreshHz - DRAWHZ) <= 1)
+        {
+            runFrame();
+        }
+        else
+        {
+            frameCredit += DRAWHZ;
+            while(frameCredit >= (unsigned int)refreshHz)
+            {
+                runFrame();
+                frameCredit -= refreshHz;
+            }
+        }
+
+        publishFrame();
+
+        // the present blocks until the vertical blank and is the clock
+        redraw = true;
+        refresh();
+    }
+}
 
-        auto curTime = std::chrono::high_resolution_clock::now();
-        auto deltaTime = std::chrono::duration_cast<std::chrono::milliseconds>(curTime - lastCycle).count(); 
-        auto deltaTime2 = std::chrono::duration_cast<std::chrono::milliseconds>(curTime - lastTimer).count();
-        auto deltaTime3 = std::chrono::duration_cast<std::chrono::milliseconds>(curTime - lastDraw).count();
+void System::loopAudio()
+{
+    while(!shutDown)
+    {
+        update();
+        applyInput();
 
-        // CPU frequency
-        if(deltaTime >= clockTime)
+        // the sound card is the clock, top its queue back up to target
+        unsigned int ran{0};
+        while(beeper.queuedFrames() < beeper.getTargetFrames() && ran < AUDIO_CATCH_UP)
         {
-            lastCycle = curTime;
-            chipEmu.run();
+            runFrame();
+            ran++;
         }
+        publishFrame();
+        refresh();
+
+        // roughly half a frame plays out before the next check
+        SDL_WaitEventTimeout(NULL, 1000 / DRAWHZ / 2);
+    }
+}
+
+void System::loop()
+{
+    if(sync == Sync::VSync)
+    {
+        loopVSync();
+    }
+    else if(sync == Sync::Audio)
+    {
+        loopAudio();
+    }
+    else
+    {
+        // emulation runs on its own thread so a slow present can't stall it
+        std::thread emuThread(&System::emulate, this);
 
-        // Delay Frequency
-        if(deltaTime2 >= delayTime)
+        while(!shutDown)
         {
-            lastTimer = curTime;
-            chipEmu.tickTimers();
+            update();
+            refresh();
 
+            // wait for input, checking for new frames every couple of ms
+            SDL_WaitEventTimeout(NULL, 2);
         }
 
-        // Draw Frequency
-        if(deltaTime3 >= drawTime)
+        emuThread.join();
+    }
+
+    if(!recordFile.empty())
+    {
+        inputLog.endCycle = scheduler.virtualCycles();
+        if(!inputLog.save(recordFile))
         {
-            lastDraw = curTime;
-            refresh(chipEmu.display, sizeof(chipEmu.display[0]) * DISPLAY_COLUMNS);
+            std::cout << "Could not write " << recordFile << "\n";
         }
+    }
+}
+
+void System::printStats() const
+{
+    std::cout << "emulated frames: " << scheduler.getFrames() << "\n"
+              << "emulated cycles: " << scheduler.getCycles() << "\n";
+
+    if(beeper.isOpen())
+    {
+        const Beeper::Stats& audio = beeper.getStats();
+        std::cout << "audio underruns: " << audio.underruns << "\n"
+                  << "audio rate: " << audio.rateRatio << "\n";
+    }
 
+    // the pacer only runs the clock in Timer mode
+    if(sync == Sync::VSync)
+    {
+        std::cout << "display refresh: " << refreshHz << " Hz\n";
+        return;
     }
+    if(sync == Sync::Audio)
+    {
+        return;
+    }
+
+    const Pacer::Stats& stats = scheduler.getPacerStats();
+    std::cout << "presented frames: " << stats.frames << "\n"
+              << "late frames: " << stats.lateFrames << "\n"
+              << "max drift: " << stats.maxDrift / 1000 << " us\n"
+              << "mean jitter: " << stats.meanJitter / 1000 << " us\n";
 }
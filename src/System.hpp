@@ -3,29 +3,111 @@
 
 #include <SDL.h>
 #include <chrono>
+#include <thread>
+#include <atomic>
 #include "Chip8.hpp"
+#include "Present.hpp"
+#include "Scheduler.hpp"
+#include "TripleBuffer.hpp"
+#include "SpscQueue.hpp"
+#include "Audio.hpp"
+#include "InputLog.hpp"
 
 
+// Display handed from the emulation thread to the render thread
+struct Frame
+{
+    uint64_t display[DISPLAY_ROWS];
+};
+
+#define KEY_REWIND 0x10 // KeyEvent key for the rewind button (backspace)
+
+// Key press or release handed from the render thread to the emulation thread
+struct KeyEvent
+{
+    uint8_t key;
+    bool pressed;
+};
+
+/*
+System picks one of three clocks for emulated frames
+    Timer: two threads
+        render thread (loop): SDL events, texture uploads and presents
+        emulation thread (emulate): input, Chip8 and Scheduler
+    Frames go one way through a triple buffer, key events the other way
+    through a queue, neither side ever blocks on the other.
+    VSync: one thread, presents wait for the vertical blank and every
+    refresh runs the emulated frames due for it, sound follows with dynamic
+    rate control
+    Audio: one thread, emulated frames are run to keep the sound queue
+    filled, presents are not synchronised
+Every emulated frame goes into a Rewind history, holding the rewind button
+plays it backwards one frame per frame. With run-ahead on, the display
+handed over is from a few frames past the real state, which cancels games
+that only react to a key a frame or two later.
+*/
 class System
 {
     public: 
+        enum class Sync { Timer, VSync, Audio };
+
         System(const char* winTitle, int windowWidth, int windowHeight, int texW, int texH);
         ~System();
         void update();
-        void refresh(const void* pixels, int pitch);
+        void refresh();
         void loadSystem(std::string fileName);
+        void setEngine(Chip8::Engine engine);
+        void setPalette(uint32_t offColour, uint32_t onColour);
+        void setSpeed(Scheduler::Mode mode, unsigned int speedPercent = 100);
+        bool setSync(Sync sync); // false if unavailable, Timer is kept
+        bool recordInput(std::string fileName); // saved when loop() ends
+        bool replayInput(std::string fileName); // live keys are ignored
+        void setRunAhead(unsigned int frames); // 0 is off
         void loop();
+        void printStats() const;
 
     private:
         SDL_Window* windowObj;
         SDL_Texture* texture;
         SDL_Renderer* renderer;
-        bool shutDown;
+        std::atomic<bool> shutDown;
+        bool redraw; // window needs presenting even if the display is unchanged
         Chip8 chipEmu;
+        Presenter presenter; // display to texture pixels
+
+        Scheduler scheduler; // decides how many emulated frames run per present
+
+        TripleBuffer<Frame> frames;
+        SpscQueue<KeyEvent, 256> inputQueue;
+
+        // render thread copy of what is in the texture
+        uint64_t shown[DISPLAY_ROWS];
+        bool uploadAll;
+
+        Sync sync;
+        Beeper beeper;
+        int refreshHz;            // display refresh rate for VSync
+        unsigned int frameCredit; // emulated frames owed, in DRAWHZ units
+
+        InputLog inputLog;
+        std::string recordFile;
+        bool replaying;
+
+        Rewind history;
+        bool rewinding;
+        uint16_t liveKeys; // keys held on the keyboard, restored states get these
+
+        // Run-ahead: frames emulated past the real state for display only
+        unsigned int runAheadFrames;
+        Chip8State aheadState;
 
-        float clockTime;
-        float delayTime;
-        float drawTime;
+        void applyInput();
+        void publishFrame();
+        void runFrame(); // one emulated frame for VSync and Audio
+        void stepBack();
+        void emulate();
+        void loopVSync();
+        void loopAudio();
 
 
         
@@ -0,0 +1,60 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+Lock-free triple buffer for one writer thread and one reader thread
+The writer fills writeBuffer() and publish()es it, the reader calls
+update() and then reads readBuffer(). Neither side ever waits, the reader
+always gets the newest published value and older unread ones are dropped.
+*/
+template<typename T>
+class TripleBuffer
+{
+    public:
+        TripleBuffer() : shared(1), writeIndex(0), readIndex(2)
+        {
+        }
+
+        T& writeBuffer()
+        {
+            return buffers[writeIndex];
+        }
+
+        void publish()
+        {
+            // hand the written buffer over, take back whatever was in the middle
+            uint8_t old = shared.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+            writeIndex = old & INDEX;
+        }
+
+        // True if a newer buffer was published since the last update()
+        bool update()
+        {
+            if(!(shared.load(std::memory_order_relaxed) & FRESH))
+            {
+                return false;
+            }
+            uint8_t old = shared.exchange(readIndex, std::memory_order_acq_rel);
+            readIndex = old & INDEX;
+            return true;
+        }
+
+        const T& readBuffer() const
+        {
+            return buffers[readIndex];
+        }
+
+    private:
+        static const uint8_t INDEX = 0x3;
+        static const uint8_t FRESH = 0x4;
+
+        T buffers[3]{};
+        std::atomic<uint8_t> shared; // index of the middle buffer | FRESH
+        uint8_t writeIndex;          // owned by the writer
+        uint8_t readIndex;           // owned by the reader
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "WorkPool.hpp"
+
+WorkPool::WorkPool(unsigned int threads)
+{
+    if(threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    workerCount = threads;
+    workers.reset(new Worker[workerCount]);
+    for(unsigned int worker{0}; worker < workerCount; worker++)
+    {
+        workers[worker].next = 0;
+        workers[worker].end = 0;
+    }
+
+    generation = 0;
+    busy = 0;
+    stopping = false;
+    job = nullptr;
+    grain = 1;
+
+    // worker 0 is whoever calls run()
+    for(unsigned int worker{1}; worker < workerCount; worker++)
+    {
+        this->threads.emplace_back(&WorkPool::workerLoop, this, worker);
+    }
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+unsigned int WorkPool::size() const
+{
+    return workerCount;
+}
+
+void WorkPool::run(size_t count, const Job& job, size_t grain)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->job = &job;
+        this->grain = std::max<size_t>(grain, 1);
+        for(unsigned int worker{0}; worker < workerCount; worker++)
+        {
+            std::lock_guard<std::mutex> rangeGuard(workers[worker].lock);
+            workers[worker].next = count * worker / workerCount;
+            workers[worker].end = count * (worker + 1) / workerCount;
+        }
+        busy = workerCount - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    work(0);
+
+    // every worker has to be out of this generation before job goes away
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return busy == 0; });
+    this->job = nullptr;
+}
+
+void WorkPool::workerLoop(unsigned int worker)
+{
+    uint64_t seen{0};
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if(stopping)
+            {
+                return;
+            }
+            seen = generation;
+        }
+
+        work(worker);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if(--busy == 0)
+        {
+            done.notify_one();
+        }
+    }
+}
+
+void WorkPool::work(unsigned int worker)
+{
+    size_t first, last;
+    while(take(worker, first, last) || (steal(worker) && take(worker, first, last)))
+    {
+        for(size_t index{first}; index < last; index++)
+        {
+            (*job)(index, worker);
+        }
+    }
+}
+
+bool WorkPool::take(unsigned int worker, size_t& first, size_t& last)
+{
+    Worker& own{workers[worker]};
+    std::lock_guard<std::mutex> guard(own.lock);
+    if(own.next >= own.end)
+    {
+        return false;
+    }
+    first = own.next;
+    last = std::min(own.next + grain, own.end);
+    own.next = last;
+    return true;
+}
+
+bool WorkPool::steal(unsigned int worker)
+{
+    // starting next door spreads the thieves over different victims
+    for(unsigned int offset{1}; offset < workerCount; offset++)
+    {
+        Worker& victim{workers[(worker + offset) % workerCount]};
+        size_t first, last;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+            size_t left{victim.end - std::min(victim.next, victim.end)};
+            if(left == 0)
+            {
+                continue;
+            }
+            // the back half, the owner keeps working from the front
+            first = victim.end - (left + 1) / 2;
+            last = victim.end;
+            victim.end = first;
+        }
+
+        Worker& own{workers[worker]};
+        std::lock_guard<std::mutex> guard(own.lock);
+        own.next = first;
+        own.end = last;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,66 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <algorithm>
+
+/*
+WorkPool runs the indices 0..count-1 of a job on persistent threads
+Each run() splits the indices into one contiguous range per worker. A
+worker takes grain indices at a time from the front of its own range, and
+when that is empty steals the back half of the next worker's range that
+still has some, so uneven tasks (a ROM that idles next to one that
+doesn't) still keep every core busy. The calling thread works as worker 0, and run() returns
+once every index is done.
+Each worker's range sits on its own cache line; the job gets the worker
+number so it can keep per-worker data the same way.
+*/
+class WorkPool
+{
+    public:
+        typedef std::function<void(size_t index, unsigned int worker)> Job;
+
+        WorkPool(unsigned int threads = 0); // 0 for one per hardware thread
+        ~WorkPool();
+        WorkPool(const WorkPool&) = delete;
+        WorkPool& operator=(const WorkPool&) = delete;
+
+        void run(size_t count, const Job& job, size_t grain = 1);
+        unsigned int size() const; // workers, counting the calling thread
+
+    private:
+        struct alignas(64) Worker
+        {
+            std::mutex lock;
+            size_t next; // indices next..end-1 are left
+            size_t end;
+        };
+
+        std::unique_ptr<Worker[]> workers;
+        unsigned int workerCount;
+        std::vector<std::thread> threads;
+
+        // generation start and end, guarded by lock
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        uint64_t generation;
+        unsigned int busy; // background workers still in this generation
+        bool stopping;
+
+        const Job* job;
+        size_t grain;
+
+        void workerLoop(unsigned int worker);
+        void work(unsigned int worker);
+        bool take(unsigned int worker, size_t& first, size_t& last);
+        bool steal(unsigned int worker);
+};
+
+#endif
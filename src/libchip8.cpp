@@ -0,0 +1,274 @@
+#include <new>
+#include "libchip8.h"
+#include "Chip8.hpp"
+#include "EnvPool.hpp"
+
+static_assert(CHIP8_DISPLAY_WIDTH == DISPLAY_COLUMNS && CHIP8_DISPLAY_HEIGHT == DISPLAY_ROWS,
+              "libchip8.h has to match the core's display");
+static_assert(CHIP8_FRAMEBUFFER_BYTES == OBSERVATION_BYTES && CHIP8_DONE_TERMINATED == DONE_TERMINATED
+              && CHIP8_DONE_TRUNCATED == DONE_TRUNCATED && CHIP8_DONE_TRAPPED == DONE_TRAPPED,
+              "libchip8.h has to match EnvPool");
+static_assert(CHIP8_TRAP_STACK_OVERFLOW == (int)Chip8::TrapKind::StackOverflow
+              && CHIP8_TRAP_STACK_UNDERFLOW == (int)Chip8::TrapKind::StackUnderflow
+              && CHIP8_TRAP_MEMORY_RANGE == (int)Chip8::TrapKind::MemoryRange
+              && CHIP8_TRAP_PC_RANGE == (int)Chip8::TrapKind::PcRange, "libchip8.h has to match Chip8::TrapKind");
+
+// The handle, a Chip8 and the frame cadence a Scheduler would keep for it
+struct chip8
+{
+    Chip8 core;
+    unsigned int cycleRemainder;
+    unsigned int timerRemainder;
+};
+
+struct chip8_envs
+{
+    EnvPool pool;
+
+    chip8_envs(uint32_t count, uint32_t threads) : pool(count, threads) {}
+};
+
+// Uses up budget cycles, fewer only after a trap (a blocked FX0A is
+// charged the rest, see Chip8::chargeKeyWait)
+static unsigned int runBudget(Chip8& core, unsigned int budget)
+{
+    unsigned int executed{0};
+    while(executed < budget)
+    {
+        executed += core.runCycles(budget - executed);
+
+        // nothing changes until the next input poll, or at all after a trap
+        if(core.syncEvents & (SYNC_KEY_WAIT | SYNC_TRAP))
+        {
+            break;
+        }
+    }
+    return executed;
+}
+
+int chip8_abi_version(void)
+{
+    return CHIP8_ABI_VERSION;
+}
+
+chip8* chip8_create(void)
+{
+    chip8* chip{new(std::nothrow) chip8};
+    if(chip)
+    {
+        chip->cycleRemainder = 0;
+        chip->timerRemainder = 0;
+    }
+    return chip;
+}
+
+void chip8_destroy(chip8* chip)
+{
+    delete chip;
+}
+
+void chip8_reset(chip8* chip)
+{
+    chip->core.reset();
+    chip->cycleRemainder = 0;
+    chip->timerRemainder = 0;
+}
+
+int chip8_load(chip8* chip, const uint8_t* rom, size_t size)
+{
+    return chip->core.loadROM(rom, size) ? 0 : -1;
+}
+
+void chip8_seed(chip8* chip, uint32_t seed)
+{
+    chip->core.seedRandom(seed);
+}
+
+void chip8_set_keys(chip8* chip, uint16_t mask)
+{
+    chip->core.setKeys(mask);
+}
+
+uint32_t chip8_step(chip8* chip, uint32_t cycles)
+{
+    return runBudget(chip->core, cycles);
+}
+
+uint32_t chip8_frame(chip8* chip)
+{
+    return chip->core.runFrame(chip->cycleRemainder, chip->timerRemainder);
+}
+
+int chip8_waiting_for_key(const chip8* chip)
+{
+    return chip->core.waitingForKey() ? 1 : 0;
+}
+
+int chip8_sound_on(const chip8* chip)
+{
+    return chip->core.soundTimer > 0 ? 1 : 0;
+}
+
+int chip8_strict_memory(void)
+{
+    return STRICT_MEMORY ? 1 : 0;
+}
+
+int chip8_get_trap(const chip8* chip, chip8_trap* trap)
+{
+    const Chip8::Trap& raised{chip->core.getTrap()};
+    if(trap)
+    {
+        trap->kind = (uint8_t)raised.kind;
+        trap->pc = raised.pc;
+        trap->opcode = raised.opcode;
+        trap->address = raised.address;
+    }
+    return (int)raised.kind;
+}
+
+void chip8_clear_trap(chip8* chip)
+{
+    chip->core.clearTrap();
+}
+
+size_t chip8_snapshot_size(void)
+{
+    return STATE_FILE_SIZE;
+}
+
+size_t chip8_snapshot(const chip8* chip, uint8_t* out, size_t size)
+{
+    return chip->core.saveState(out, size);
+}
+
+int chip8_restore(chip8* chip, const uint8_t* in, size_t size)
+{
+    return chip->core.loadState(in, size) ? 0 : -1;
+}
+
+uint64_t chip8_state_hash(const chip8* chip)
+{
+    return chip->core.stateHash();
+}
+
+const uint64_t* chip8_framebuffer(const chip8* chip)
+{
+    return chip->core.display;
+}
+
+void chip8_framebuffer_1bpp(const chip8* chip, uint8_t* out)
+{
+    chip->core.packDisplay(out);
+}
+
+chip8_envs* chip8_envs_create(uint32_t count, uint32_t threads)
+{
+    // nothing may throw across the C interface
+    try
+    {
+        return new chip8_envs(count, threads);
+    }
+    catch(...)
+    {
+        return nullptr;
+    }
+}
+
+void chip8_envs_destroy(chip8_envs* envs)
+{
+    delete envs;
+}
+
+uint32_t chip8_envs_count(const chip8_envs* envs)
+{
+    return envs->pool.size();
+}
+
+int chip8_envs_load(chip8_envs* envs, const uint8_t* rom, size_t size)
+{
+    try
+    {
+        return envs->pool.loadROM(rom, size) ? 0 : -1;
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+void chip8_envs_seed(chip8_envs* envs, uint32_t seed)
+{
+    envs->pool.seed(seed);
+}
+
+int chip8_envs_add_reward(chip8_envs* envs, uint16_t address, uint8_t bytes, int digits, float weight)
+{
+    try
+    {
+        return envs->pool.addReward({address, bytes, digits != 0, weight}) ? 0 : -1;
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+int chip8_envs_add_done(chip8_envs* envs, uint16_t address, uint8_t mask, uint8_t value)
+{
+    try
+    {
+        envs->pool.addDone({address, mask, value});
+        return 0;
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+void chip8_envs_set_max_frames(chip8_envs* envs, uint32_t max_frames)
+{
+    envs->pool.maxFrames = max_frames;
+}
+
+int chip8_envs_reset(chip8_envs* envs)
+{
+    try
+    {
+        envs->pool.reset();
+        return 0;
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+int chip8_envs_step(chip8_envs* envs, const uint16_t* actions, uint32_t frame_skip)
+{
+    try
+    {
+        envs->pool.step(actions, frame_skip);
+        return 0;
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+const uint8_t* chip8_envs_observations(const chip8_envs* envs)
+{
+    return envs->pool.observations();
+}
+
+const float* chip8_envs_rewards(const chip8_envs* envs)
+{
+    return envs->pool.rewards();
+}
+
+const uint8_t* chip8_envs_dones(const chip8_envs* envs)
+{
+    return envs->pool.dones();
+}
@@ -0,0 +1,161 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+/*
+libchip8, the emulator core behind a plain C interface
+For embedding in other programs and for loading from Python (ctypes, cffi),
+Go (cgo), Rust and the like. Build with "make libchip8" for libchip8.a and
+libchip8.so, neither of which needs SDL or the C++ iostreams.
+Only what is declared here is exported. The calls never throw or exit, and
+ones that can fail return 0 on success and -1 on failure. A handle may be
+used from any thread, but only from one thread at a time.
+Frames are the same ones chip8-headless runs (a FixedStep Scheduler):
+CLOCKHZ/DRAWHZ cycles, which FX0A waiting for a key uses up without
+running anything, then the timers. The same ROM, seed and keys give the same chip8_state_hash() as
+chip8-headless --hash.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+    #if defined(CHIP8_BUILD_SHARED)
+        #define CHIP8_API __declspec(dllexport)
+    #elif defined(CHIP8_SHARED)
+        #define CHIP8_API __declspec(dllimport)
+    #else
+        #define CHIP8_API
+    #endif
+#else
+    #define CHIP8_API __attribute__((visibility("default")))
+#endif
+
+// Bumped whenever a call changes in a way old callers would notice
+#define CHIP8_ABI_VERSION 1
+
+#define CHIP8_DISPLAY_WIDTH 64
+#define CHIP8_DISPLAY_HEIGHT 32
+#define CHIP8_FRAMEBUFFER_BYTES (CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT / 8)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8 chip8;
+
+// CHIP8_ABI_VERSION of the library actually loaded
+CHIP8_API int chip8_abi_version(void);
+
+// NULL if out of memory. The machine starts powered on with no ROM.
+CHIP8_API chip8* chip8_create(void);
+CHIP8_API void chip8_destroy(chip8* chip);
+
+// Power cycle, RAM and all, so the ROM has to be loaded again
+CHIP8_API void chip8_reset(chip8* chip);
+// Copies size bytes to 0x200, -1 if they don't fit
+CHIP8_API int chip8_load(chip8* chip, const uint8_t* rom, size_t size);
+// Seeds CXNN, which is seeded from the clock otherwise
+CHIP8_API void chip8_seed(chip8* chip, uint32_t seed);
+// Bit k set while key k is held, releases and presses end FX0A waits
+CHIP8_API void chip8_set_keys(chip8* chip, uint16_t mask);
+
+// Runs up to cycles instructions without ticking the timers. Returns the
+// cycles used, which are not all instructions run: once FX0A waits for a
+// key it uses up the rest of them, as the hardware would re-executing it.
+// Less than cycles only after a trap.
+CHIP8_API uint32_t chip8_step(chip8* chip, uint32_t cycles);
+// Runs one frame, returns the cycles used, counted like chip8_step()
+CHIP8_API uint32_t chip8_frame(chip8* chip);
+// Whether FX0A is waiting for a key, frames do nothing but tick the timers
+CHIP8_API int chip8_waiting_for_key(const chip8* chip);
+// Nonzero while the sound timer runs
+CHIP8_API int chip8_sound_on(const chip8* chip);
+
+// Traps stop the machine when a ROM reaches outside RAM or the stack, but
+// only in a library built with the strict memory model (make libchip8
+// STRICT=1). The default fast model wraps such accesses around instead.
+#define CHIP8_TRAP_NONE 0
+#define CHIP8_TRAP_STACK_OVERFLOW 1
+#define CHIP8_TRAP_STACK_UNDERFLOW 2
+#define CHIP8_TRAP_MEMORY_RANGE 3
+#define CHIP8_TRAP_PC_RANGE 4
+
+typedef struct chip8_trap
+{
+    uint8_t kind;     // CHIP8_TRAP_*
+    uint16_t pc;      // of the instruction that trapped
+    uint16_t opcode;  // 0 for CHIP8_TRAP_PC_RANGE
+    uint16_t address; // first address out of range, or the stack pointer
+} chip8_trap;
+
+// Nonzero when built with the strict memory model
+CHIP8_API int chip8_strict_memory(void);
+// The trap's kind, CHIP8_TRAP_NONE while running. Fills in *trap if not NULL.
+CHIP8_API int chip8_get_trap(const chip8* chip, chip8_trap* trap);
+// Lets a trapped machine run again, from the trapping instruction
+CHIP8_API void chip8_clear_trap(chip8* chip);
+
+// Snapshots are saved state files (what chip8-headless --save-state writes),
+// versioned and checksummed, chip8_snapshot_size() bytes each
+CHIP8_API size_t chip8_snapshot_size(void);
+// Returns the bytes written, 0 if size is too small
+CHIP8_API size_t chip8_snapshot(const chip8* chip, uint8_t* out, size_t size);
+// -1 if the snapshot is damaged or from an incompatible version
+CHIP8_API int chip8_restore(chip8* chip, const uint8_t* in, size_t size);
+CHIP8_API uint64_t chip8_state_hash(const chip8* chip);
+
+// CHIP8_DISPLAY_HEIGHT rows, column 0 in the top bit. Valid until the
+// handle is destroyed, and changes as the machine runs.
+CHIP8_API const uint64_t* chip8_framebuffer(const chip8* chip);
+// The same as CHIP8_FRAMEBUFFER_BYTES packed bytes, row by row, leftmost
+// pixel in the top bit
+CHIP8_API void chip8_framebuffer_1bpp(const chip8* chip, uint8_t* out);
+
+/*
+Environment pools, many copies of one ROM stepped together on a thread
+pool for reinforcement learning (see EnvPool.hpp). Results land in buffers
+that live as long as the pool, so wrap them once, ex. with
+numpy.ctypeslib.as_array(pointer, shape), and read every step in place.
+*/
+typedef struct chip8_envs chip8_envs;
+
+// Done flags
+#define CHIP8_DONE_TERMINATED 0x1 // a done condition held
+#define CHIP8_DONE_TRUNCATED 0x2  // the episode reached the frame limit
+#define CHIP8_DONE_TRAPPED 0x4    // the strict memory model stopped it
+
+// NULL if out of memory or threads can't be started. threads 0 for one per
+// hardware thread. Every environment starts powered on with no ROM.
+CHIP8_API chip8_envs* chip8_envs_create(uint32_t count, uint32_t threads);
+CHIP8_API void chip8_envs_destroy(chip8_envs* envs);
+CHIP8_API uint32_t chip8_envs_count(const chip8_envs* envs);
+
+// Loads the ROM and resets every environment, -1 if it doesn't fit
+CHIP8_API int chip8_envs_load(chip8_envs* envs, const uint8_t* rom, size_t size);
+// Episode k of environment i is seeded with seed + i + k * count
+CHIP8_API void chip8_envs_seed(chip8_envs* envs, uint32_t seed);
+// The reward is the change in the sum of weight * score over these terms,
+// each score bytes (1 to 8) bytes at address, most significant first, or
+// decimal digits one per byte when digits is nonzero. -1 for a bad length.
+CHIP8_API int chip8_envs_add_reward(chip8_envs* envs, uint16_t address, uint8_t bytes, int digits, float weight);
+// An episode ends when (ram[address] & mask) == value after any frame
+CHIP8_API int chip8_envs_add_done(chip8_envs* envs, uint16_t address, uint8_t mask, uint8_t value);
+// ... or after max_frames frames, 0 for no limit
+CHIP8_API void chip8_envs_set_max_frames(chip8_envs* envs, uint32_t max_frames);
+
+// Starts a new episode everywhere, observations show the first frame
+CHIP8_API int chip8_envs_reset(chip8_envs* envs);
+// Holds actions[i] (a keypad mask like chip8_set_keys) on environment i
+// for frame_skip frames. Environments that were done start a new episode.
+CHIP8_API int chip8_envs_step(chip8_envs* envs, const uint16_t* actions, uint32_t frame_skip);
+
+// count * CHIP8_FRAMEBUFFER_BYTES, packed like chip8_framebuffer_1bpp()
+CHIP8_API const uint8_t* chip8_envs_observations(const chip8_envs* envs);
+CHIP8_API const float* chip8_envs_rewards(const chip8_envs* envs);
+CHIP8_API const uint8_t* chip8_envs_dones(const chip8_envs* envs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
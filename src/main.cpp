@@ -1,3 +1,4 @@
+#include <iostream>
 #include "System.hpp"
 #include "Chip8.hpp"
 
@@ -6,7 +7,80 @@ int main(int argc, char* argv[])
     System mainSys("CHIP-8", DISPLAY_COLUMNS*10, DISPLAY_ROWS*10, DISPLAY_COLUMNS, DISPLAY_ROWS);
     
     mainSys.loadSystem(argv[1]);
+
+    // options, ex. Chip8 "Pong.ch8" --blocks --palette 000000 33FF66
+    bool printStats{false};
+    for(int i{2}; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--blocks") == 0)
+        {
+            mainSys.setEngine(Chip8::Engine::Blocks);
+        }
+        else if(strcmp(argv[i], "--verify") == 0)
+        {
+            mainSys.setEngine(Chip8::Engine::Verify);
+        }
+        else if(strcmp(argv[i], "--palette") == 0 && i + 2 < argc)
+        {
+            uint32_t offColour = std::stoul(argv[i + 1], nullptr, 16);
+            uint32_t onColour = std::stoul(argv[i + 2], nullptr, 16);
+            mainSys.setPalette(offColour, onColour);
+            i += 2;
+        }
+        else if(strcmp(argv[i], "--turbo") == 0)
+        {
+            mainSys.setSpeed(Scheduler::Mode::Turbo);
+        }
+        else if(strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+        {
+            // multiplier, ex. 0.5 for slow motion or 4 for fast forward
+            mainSys.setSpeed(Scheduler::Mode::Speed, std::stod(argv[++i]) * 100);
+        }
+        else if(strcmp(argv[i], "--fixed") == 0)
+        {
+            mainSys.setSpeed(Scheduler::Mode::FixedStep);
+        }
+        else if(strcmp(argv[i], "--vsync") == 0)
+        {
+            if(!mainSys.setSync(System::Sync::VSync))
+            {
+                std::cout << "VSync unavailable, using the timer\n";
+            }
+        }
+        else if(strcmp(argv[i], "--audio-clock") == 0)
+        {
+            if(!mainSys.setSync(System::Sync::Audio))
+            {
+                std::cout << "No audio device, using the timer\n";
+            }
+        }
+        else if(strcmp(argv[i], "--runahead") == 0 && i + 1 < argc)
+        {
+            mainSys.setRunAhead(std::stoul(argv[++i]));
+        }
+        else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            mainSys.recordInput(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            if(!mainSys.replayInput(argv[++i]))
+            {
+                std::cout << "Could not read " << argv[i] << "\n";
+            }
+        }
+        else if(strcmp(argv[i], "--stats") == 0)
+        {
+            printStats = true;
+        }
+    }
+
     mainSys.loop();
 
+    if(printStats)
+    {
+        mainSys.printStats();
+    }
+
     return 0;
 }
\ No newline at end of file
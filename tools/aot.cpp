@@ -0,0 +1,363 @@
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <iomanip>
+#include "../src/Chip8.hpp"
+
+/*
+Ahead-of-time recompiler
+Translates the code reachable from RAM_START in a ROM into a C++ source
+file that drives a Chip8 instance directly
+    chip8-aot rom.ch8 out.cpp [name]
+
+The generated file defines
+    void <name>Load(Chip8& chip);                            loads the ROM
+    unsigned int <name>Run(Chip8& chip, unsigned int budget); like runCycles
+
+Register and ALU instructions are emitted inline, everything touching
+memory, the display, timers or input calls back into Chip8 so the
+semantics stay shared with the interpreter. Addresses that were not found
+statically (BNNN targets) and code that was overwritten at runtime fall
+back to the interpreter.
+*/
+
+static std::string hex(unsigned int value, int width)
+{
+    std::ostringstream out;
+    out << "0x" << std::uppercase << std::hex << std::setw(width) << std::setfill('0') << value;
+    return out.str();
+}
+
+// true if execution can continue with the next instruction
+static bool fallsThrough(uint16_t op)
+{
+    switch((op & 0xF000) >> 12)
+    {
+        case 0x0:
+            return (op & 0x0FFF) != 0x0EE;
+        case 0x1:
+        case 0x2:
+        case 0xB:
+            return false;
+    }
+    return true;
+}
+
+static bool isSkip(uint16_t op)
+{
+    switch((op & 0xF000) >> 12)
+    {
+        case 0x3:
+        case 0x4:
+            return true;
+        case 0x5:
+        case 0x9:
+            return (op & 0x000F) == 0;
+        case 0xE:
+            return (op & 0x00FF) == 0x9E || (op & 0x00FF) == 0xA1;
+    }
+    return false;
+}
+
+// Walks every path from RAM_START, marking instruction start addresses
+static std::vector<bool> findCode(const std::vector<uint8_t>& rom)
+{
+    std::vector<bool> code(RAM_SIZE, false);
+    std::vector<uint16_t> pending{RAM_START};
+    uint32_t romEnd = RAM_START + rom.size();
+
+    while(!pending.empty())
+    {
+        uint16_t addr = pending.back();
+        pending.pop_back();
+
+        // only translate what is actually in the ROM
+        if(addr < RAM_START || addr + 1u >= romEnd || code[addr])
+        {
+            continue;
+        }
+        code[addr] = true;
+
+        uint16_t op = (rom[addr - RAM_START] << 8) | rom[addr + 1 - RAM_START];
+        switch((op & 0xF000) >> 12)
+        {
+            case 0x1:
+                pending.push_back(op & 0x0FFF);
+                break;
+            case 0x2:
+                pending.push_back(op & 0x0FFF);
+                pending.push_back(addr + 2);
+                break;
+            default:
+                if(isSkip(op))
+                {
+                    pending.push_back(addr + 4);
+                }
+                if(fallsThrough(op))
+                {
+                    pending.push_back(addr + 2);
+                }
+                break;
+        }
+    }
+    return code;
+}
+
+// Inline C++ for register-only instructions, empty if the op needs Chip8
+static std::string inlineBody(uint16_t op)
+{
+    std::string x = "chip.registers[" + hex((op & 0x0F00) >> 8, 1) + "]";
+    std::string y = "chip.registers[" + hex((op & 0x00F0) >> 4, 1) + "]";
+    std::string vf = "chip.registers[0xF]";
+    std::string nn = hex(op & 0x00FF, 2);
+
+    switch((op & 0xF000) >> 12)
+    {
+        case 0x6:
+            return x + " = " + nn + ";";
+        case 0x7:
+            return x + " += " + nn + ";";
+        case 0x8:
+            switch(op & 0x000F)
+            {
+                case 0x0:
+                    return x + " = " + y + ";";
+                case 0x1:
+                    return x + " |= " + y + "; " + vf + " = 0;";
+                case 0x2:
+                    return x + " &= " + y + "; " + vf + " = 0;";
+                case 0x3:
+                    return x + " ^= " + y + "; " + vf + " = 0;";
+                case 0x4:
+                    return "{ uint16_t sum = " + x + " + " + y + "; " + x + " = sum & 0xFF; "
+                        + vf + " = sum > 0xFF; }";
+                case 0x5:
+                    return "{ bool flag = " + x + " >= " + y + "; " + x + " -= " + y + "; "
+                        + vf + " = flag; }";
+                case 0x6:
+                    return "{ uint8_t bit = " + y + " & 0x1; " + x + " = " + y + " >> 1; "
+                        + vf + " = bit; }";
+                case 0x7:
+                    return "{ bool flag = " + y + " >= " + x + "; " + x + " = " + y + " - " + x + "; "
+                        + vf + " = flag; }";
+                case 0xE:
+                    return "{ uint8_t bit = " + y + " >> 7; " + x + " = " + y + " << 1; "
+                        + vf + " = bit; }";
+            }
+            break;
+        case 0xA:
+            return "chip.indexReg = " + hex(op & 0x0FFF, 3) + ";";
+        case 0xF:
+            if((op & 0x00FF) == 0x1E)
+            {
+                return "chip.indexReg += " + x + ";";
+            }
+            break;
+    }
+    return "";
+}
+
+static std::string skipCondition(uint16_t op)
+{
+    std::string x = "chip.registers[" + hex((op & 0x0F00) >> 8, 1) + "]";
+    std::string y = "chip.registers[" + hex((op & 0x00F0) >> 4, 1) + "]";
+    std::string nn = hex(op & 0x00FF, 2);
+
+    switch((op & 0xF000) >> 12)
+    {
+        case 0x3:
+            return x + " == " + nn;
+        case 0x4:
+            return x + " != " + nn;
+        case 0x5:
+            return x + " == " + y;
+        case 0x9:
+            return x + " != " + y;
+    }
+    return "";
+}
+
+// Each instruction gets its own case so any address can be entered, and
+// falls through into the next one while the budget lasts
+static void emitInstruction(std::ostream& out, uint16_t addr, uint16_t op, bool nextIsCode)
+{
+    std::string next = hex(addr + 2, 3);
+    std::string body = inlineBody(op);
+    std::string condition = skipCondition(op);
+
+    out << "            case " << hex(addr, 3) << ": // " << hex(op, 4) << "\n";
+
+    // inline instructions leave opcode behind the same as runOpcode() does,
+    // it is part of the saved state
+    if((op & 0xF000) == 0x1000 || !condition.empty() || !body.empty())
+    {
+        out << "                chip.opcode = " << hex(op, 4) << ";\n";
+    }
+    if((op & 0xF000) == 0x1000)
+    {
+        out << "                chip.pc = " << hex(op & 0x0FFF, 3) << ";\n";
+        out << "                cycles++;\n";
+        out << "                continue;\n";
+        return;
+    }
+    if(!condition.empty())
+    {
+        out << "                if(" << condition << ")\n";
+        out << "                {\n";
+        out << "                    chip.pc = " << hex(addr + 4, 3) << ";\n";
+        out << "                    cycles++;\n";
+        out << "                    continue;\n";
+        out << "                }\n";
+        out << "                chip.pc = " << next << ";\n";
+    }
+    else if(!body.empty())
+    {
+        out << "                " << body << "\n";
+        out << "                chip.pc = " << next << ";\n";
+    }
+    else
+    {
+        out << "                chip.runOpcode(" << hex(op, 4) << ");\n";
+    }
+    out << "                cycles++;\n";
+
+    // pc may be anywhere now (calls, returns, BNNN, key skips, FX0A waiting)
+    if(!fallsThrough(op) || (isSkip(op) && condition.empty()) || (op & 0xF0FF) == 0xF00A)
+    {
+        out << "                continue;\n";
+        return;
+    }
+    // stores may have overwritten the code we are about to run
+    if((op & 0xF0FF) == 0xF033 || (op & 0xF0FF) == 0xF055)
+    {
+        out << "                if(chip.staticCodeModified())\n";
+        out << "                {\n";
+        out << "                    continue;\n";
+        out << "                }\n";
+    }
+    if(!nextIsCode)
+    {
+        out << "                continue;\n";
+        return;
+    }
+    out << "                if(cycles >= budget" << (body.empty() && condition.empty() ? " || chip.syncEvents" : "") << ")\n";
+    out << "                {\n";
+    out << "                    return cycles;\n";
+    out << "                }\n";
+    out << "                [[fallthrough]];\n";
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3)
+    {
+        std::cout << "usage: chip8-aot rom.ch8 out.cpp [name]\n";
+        return 1;
+    }
+    std::string name{argc > 3 ? argv[3] : "aot"};
+
+    // more than fits in RAM, so a file too big still reads as too big
+    std::ifstream inputFile(argv[1], std::ios::binary);
+    std::vector<uint8_t> rom(RAM_SIZE);
+    inputFile.read(reinterpret_cast<char*>(rom.data()), rom.size());
+    rom.resize(inputFile.gcount());
+    if(!inputFile.is_open() || inputFile.bad() || rom.empty())
+    {
+        std::cout << "Could not read " << argv[1] << "\n";
+        return 1;
+    }
+    if(rom.size() > RAM_SIZE - RAM_START)
+    {
+        std::cout << argv[1] << " will not fit in RAM\n";
+        return 1;
+    }
+
+    std::vector<bool> code{findCode(rom)};
+
+    std::ofstream out(argv[2]);
+    if(!out.is_open())
+    {
+        std::cout << "Could not write " << argv[2] << "\n";
+        return 1;
+    }
+    out << "// Generated by chip8-aot from " << std::filesystem::path(argv[1]).filename().string() << "\n";
+    out << "// Do not edit, rerun chip8-aot instead\n";
+    out << "#include \"Chip8.hpp\"\n\n";
+
+    out << "static const uint8_t " << name << "Rom[" << rom.size() << "] =\n{";
+    for(size_t i{0}; i < rom.size(); i++)
+    {
+        out << (i % 12 == 0 ? "\n    " : " ") << hex(rom[i], 2) << (i + 1 < rom.size() ? "," : "");
+    }
+    out << "\n};\n\n";
+
+    out << "void " << name << "Load(Chip8& chip)\n";
+    out << "{\n";
+    out << "    chip.loadROM(" << name << "Rom, sizeof(" << name << "Rom));\n";
+    for(uint16_t addr{RAM_START}; addr < RAM_SIZE; addr++)
+    {
+        if(!code[addr])
+        {
+            continue;
+        }
+        // one call per run of back to back instructions
+        uint16_t end{addr};
+        while(end + 2 < RAM_SIZE && code[end + 2])
+        {
+            end += 2;
+        }
+        out << "    chip.markStaticCode(" << hex(addr, 3) << ", " << end + 2 - addr << ");\n";
+        addr = end;
+    }
+    out << "}\n\n";
+
+    out << "unsigned int " << name << "Run(Chip8& chip, unsigned int budget)\n";
+    out << "{\n";
+    out << "    unsigned int cycles{0};\n";
+    out << "    chip.syncEvents = 0;\n";
+    out << "    if(STRICT_MEMORY && chip.trapped())\n";
+    out << "    {\n";
+    out << "        chip.syncEvents |= SYNC_TRAP;\n";
+    out << "        return 0;\n";
+    out << "    }\n";
+    out << "    while(cycles < budget && !chip.syncEvents)\n";
+    out << "    {\n";
+    out << "        // overwritten code or a key wait is left to the interpreter\n";
+    out << "        if(chip.staticCodeModified() || chip.waitingForKey())\n";
+    out << "        {\n";
+    out << "            cycles += chip.runCycles(1);\n";
+    out << "            continue;\n";
+    out << "        }\n\n";
+    out << "        switch(chip.pc)\n";
+    out << "        {\n";
+    for(uint16_t addr{RAM_START}; addr < RAM_SIZE; addr++)
+    {
+        if(!code[addr])
+        {
+            continue;
+        }
+        uint16_t op = (rom[addr - RAM_START] << 8) | rom[addr + 1 - RAM_START];
+        emitInstruction(out, addr, op, addr + 2 < RAM_SIZE && code[addr + 2]);
+    }
+    out << "            default: // computed jump target or code outside the ROM\n";
+    out << "                cycles += chip.runCycles(1);\n";
+    out << "                break;\n";
+    out << "        }\n";
+    out << "    }\n\n";
+    out << "    // blocked in FX0A, see Chip8::chargeKeyWait\n";
+    out << "    if(chip.waitingForKey() && chip.chargeKeyWait)\n";
+    out << "    {\n";
+    out << "        return budget;\n";
+    out << "    }\n";
+    out << "    return cycles;\n";
+    out << "}\n";
+
+    if(!out.good())
+    {
+        std::cout << "Could not write " << argv[2] << "\n";
+        return 1;
+    }
+    return 0;
+}
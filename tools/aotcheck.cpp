@@ -0,0 +1,86 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "../src/Chip8.hpp"
+
+/*
+Checks code generated by chip8-aot against the interpreter
+Runs the translated ROM and the same ROM on the interpreter side by side,
+with the same seed and keys, and compares the state hashes after every
+frame
+    make -f MakeFile aot-check
+translates, builds and checks every ROM in ROMs/, or one by hand with
+    chip8-aot rom.ch8 out.cpp
+    g++ -std=c++17 -O2 -Isrc -o chip8-aot-check tools/aotcheck.cpp out.cpp src/Chip8.cpp
+    chip8-aot-check rom.ch8 [frames]
+*/
+
+// Defined by the generated file, built with the default name
+void aotLoad(Chip8& chip);
+unsigned int aotRun(Chip8& chip, unsigned int budget);
+
+typedef unsigned int (*RunFunction)(Chip8& chip, unsigned int budget);
+
+static unsigned int interpreterRun(Chip8& chip, unsigned int budget)
+{
+    return chip.runCycles(budget);
+}
+
+// One frame's cycles, fewer once nothing more can run (a trap, or FX0A
+// with chargeKeyWait off), then the timers
+static void runFrame(Chip8& chip, RunFunction run)
+{
+    unsigned int executed{0};
+    while(executed < CLOCKHZ / DRAWHZ)
+    {
+        unsigned int used{run(chip, CLOCKHZ / DRAWHZ - executed)};
+        if(used == 0)
+        {
+            break;
+        }
+        executed += used;
+    }
+    chip.tickTimers();
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::cout << "usage: chip8-aot-check rom.ch8 [frames]\n";
+        return 1;
+    }
+    unsigned long frames{argc > 2 ? std::stoul(argv[2]) : 3000};
+
+    std::ifstream inputFile(argv[1], std::ios::binary);
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
+    Chip8 interpreter;
+    if(!inputFile.is_open() || !interpreter.loadROM(rom.data(), rom.size()))
+    {
+        std::cout << "Could not load " << argv[1] << "\n";
+        return 1;
+    }
+    Chip8 translated;
+    aotLoad(translated);
+    interpreter.seedRandom(1);
+    translated.seedRandom(1);
+
+    for(unsigned long frame{0}; frame < frames; frame++)
+    {
+        // a different pair of keys every few frames, with gaps for releases
+        uint16_t keys = frame % 4 == 3 ? 0 : 0x11 << (frame / 4 % 12);
+        interpreter.setKeys(keys);
+        translated.setKeys(keys);
+        runFrame(interpreter, interpreterRun);
+        runFrame(translated, aotRun);
+
+        if(interpreter.stateHash() != translated.stateHash() || interpreter.trapped() != translated.trapped())
+        {
+            std::cout << argv[1] << ": differs from the interpreter after frame " << frame + 1 << "\n";
+            return 1;
+        }
+    }
+    std::cout << argv[1] << ": same as the interpreter for " << frames << " frames, state "
+              << std::hex << interpreter.stateHash() << std::dec << "\n";
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include "../src/Batch.hpp"
+
+/*
+Parallel batch runner, for test corpora and bot evaluation
+Runs every task headless on a work-stealing thread pool and prints each
+one's final state hash (the same as chip8-headless --hash gives) and stats
+    chip8-batch [options] rom.ch8...
+        --threads N      workers (default one per hardware thread)
+        --frames N       frames per ROM given on the command line (default 600)
+        --copies K       run each ROM given on the command line K times
+        --seed N         CXNN seed for ROMs given on the command line
+        --tasks file     one task per line: rom frames [input.c8in] [seed]
+                         (frames 0 runs to the end of the input, paths
+                         with spaces go in double quotes)
+        --blocks         use the block engine
+        --no-idle        run spin-wait loops instead of skipping them
+        --quiet          only print the totals
+*/
+
+static bool readTasks(const char* fileName, std::vector<BatchTask>& tasks)
+{
+    std::ifstream file(fileName);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    std::string line;
+    while(std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        BatchTask task{"", "", 0, 0};
+        if(!(fields >> std::quoted(task.rom)) || task.rom[0] == '#')
+        {
+            continue;
+        }
+        fields >> task.frames;
+        std::string field;
+        if(fields >> std::quoted(field))
+        {
+            // a lone number is the seed, anything else an input script
+            if(field.find_first_not_of("0123456789") == std::string::npos)
+            {
+                task.seed = std::stoul(field);
+            }
+            else
+            {
+                task.inputScript = field;
+                fields >> task.seed;
+            }
+        }
+        tasks.push_back(task);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int threads{0};
+    uint64_t frames{600};
+    unsigned int copies{1};
+    uint32_t seed{0};
+    bool quiet{false};
+    Chip8::Engine engine{Chip8::Engine::Interpreter};
+    bool skipIdle{true};
+    std::vector<BatchTask> tasks;
+    std::vector<std::string> roms;
+
+    for(int i{1}; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = std::stoul(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = std::stoull(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--copies") == 0 && i + 1 < argc)
+        {
+            copies = std::stoul(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::stoul(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--tasks") == 0 && i + 1 < argc)
+        {
+            if(!readTasks(argv[++i], tasks))
+            {
+                std::cout << "Could not read " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--blocks") == 0)
+        {
+            engine = Chip8::Engine::Blocks;
+        }
+        else if(strcmp(argv[i], "--no-idle") == 0)
+        {
+            skipIdle = false;
+        }
+        else if(strcmp(argv[i], "--quiet") == 0)
+        {
+            quiet = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            std::cout << "Unknown option " << argv[i] << "\n";
+            return 1;
+        }
+        else
+        {
+            roms.push_back(argv[i]);
+        }
+    }
+
+    for(unsigned int copy{0}; copy < copies; copy++)
+    {
+        for(const std::string& rom : roms)
+        {
+            tasks.push_back({rom, "", frames, seed});
+        }
+    }
+    if(tasks.empty())
+    {
+        std::cout << "usage: chip8-batch [--threads N] [--frames N] [--copies K] [--seed N]"
+                     " [--tasks file] [--blocks] [--no-idle] [--quiet] ROMs...\n";
+        return 1;
+    }
+
+    BatchRunner runner(threads);
+    runner.engine = engine;
+    runner.skipIdle = skipIdle;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results{runner.run(tasks)};
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    uint64_t totalCycles{0};
+    uint64_t totalFrames{0};
+    unsigned int failed{0};
+    for(size_t i{0}; i < results.size(); i++)
+    {
+        const BatchResult& result{results[i]};
+        if(!result.ok)
+        {
+            std::cout << tasks[i].rom << ": " << result.error << "\n";
+            failed++;
+            continue;
+        }
+        totalCycles += result.cycles;
+        totalFrames += result.frames;
+        if(!quiet)
+        {
+            std::cout << tasks[i].rom << ": " << std::hex << result.stateHash << std::dec << " "
+                      << result.frames << " frames " << result.cycles << " cycles "
+                      << result.idleCycles << " idle " << result.seconds * 1e3 << " ms\n";
+        }
+    }
+
+    std::cout << results.size() << " tasks on " << runner.threads() << " threads in " << elapsed.count()
+              << " s: " << totalFrames / elapsed.count() << " frames/s, " << totalCycles / elapsed.count() / 1e6
+              << " MIPS\n";
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,316 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "../src/Chip8.hpp"
+#include "../src/Present.hpp"
+#include "../src/Rewind.hpp"
+#include "../src/Chip8Batch.hpp"
+
+/*
+Interpreter throughput benchmark
+Runs every ROM given on the command line headless for a fixed number of
+frames (CLOCKHZ/DRAWHZ cycles each) and reports millions of emulated
+instructions per second (MIPS)
+    chip8-bench [--blocks | --verify | --switch] [--no-idle] [--state] [--rewind] [--batch N] [--frames N] rom.ch8...
+
+--switch runs the interpreter the way it was before the opcode table, a
+switch on every fetched opcode, to measure table dispatch and the decode
+cache against: compare a run with it to one without on the same ROMs.
+With --present it instead times the framebuffer to texture expansion for
+every kernel at a few source sizes and scales. --state also times
+saveState() and loadState() on each ROM, restoring snapshots a second of
+emulation apart like rewind or run-ahead would. --rewind times pushing two
+minutes of frames into a default Rewind and stepping all the way back.
+--batch N also runs N copies of each ROM (CXNN seeds 0..N-1) in a
+Chip8Batch, with each kernel, for a tenth of the frames.
+*/
+
+static void benchPresent()
+{
+    struct Size { int width; int height; int scale; };
+    const Size sizes[] = { {64, 32, 1}, {128, 64, 1}, {64, 32, 10}, {128, 64, 10} };
+    const char* kernelNames[] = { "scalar", "sse2", "avx2" };
+    const char* formatNames[] = { "ARGB8888", "RGB332" };
+
+    // random 1bpp source, big enough for the largest size
+    std::mt19937_64 randomGen(1);
+    std::vector<uint64_t> rows(128 / 64 * 64);
+    for(uint64_t& word : rows)
+    {
+        word = randomGen();
+    }
+
+    for(const Size& size : sizes)
+    {
+        for(int format{0}; format < 2; format++)
+        {
+            for(int kernel{0}; kernel <= (int)Presenter::bestKernel(); kernel++)
+            {
+                Presenter presenter(size.width, size.height, size.scale, (Presenter::Format)format);
+                presenter.setKernel((Presenter::Kernel)kernel);
+
+                const unsigned int frames{size.scale == 1 ? 200000u : 2000u};
+                auto start = std::chrono::steady_clock::now();
+                for(unsigned int frame{0}; frame < frames; frame++)
+                {
+                    rows[frame % rows.size()] ^= 1; // keep the compiler honest
+                    presenter.present(rows.data());
+                }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                std::cout << size.width << "x" << size.height << " -> " << presenter.width() << "x"
+                          << presenter.height() << " " << formatNames[format] << " " << kernelNames[kernel]
+                          << ": " << elapsed.count() / frames * 1e9 << " ns/frame\n";
+            }
+        }
+    }
+}
+
+static bool readROM(const char* fileName, std::vector<uint8_t>& rom)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    // more than fits in RAM, so a file too big still reads as too big
+    rom.resize(RAM_SIZE);
+    file.read(reinterpret_cast<char*>(rom.data()), rom.size());
+    rom.resize(file.gcount());
+    return !file.bad() && !rom.empty();
+}
+
+static void benchState(Chip8& chipEmu)
+{
+    const unsigned int cyclesPerFrame{CLOCKHZ / DRAWHZ};
+    const unsigned int rounds{200000};
+    Chip8State states[2];
+
+    chipEmu.saveState(states[0]);
+    for(unsigned int frame{0}; frame < DRAWHZ; frame++)
+    {
+        chipEmu.runCycles(cyclesPerFrame);
+        chipEmu.tickTimers();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned int round{0}; round < rounds; round++)
+    {
+        chipEmu.saveState(states[1]);
+    }
+    std::chrono::duration<double> saveTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for(unsigned int round{0}; round < rounds; round++)
+    {
+        chipEmu.loadState(states[round & 0x1]);
+    }
+    std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "    state: " << sizeof(Chip8State) << " bytes, save " << saveTime.count() / rounds * 1e9
+              << " ns, load " << loadTime.count() / rounds * 1e9 << " ns\n";
+}
+
+static void benchRewind(Chip8& chipEmu)
+{
+    const unsigned int cyclesPerFrame{CLOCKHZ / DRAWHZ};
+    const unsigned int frames{120 * DRAWHZ};
+
+    // the states come first so only Rewind gets timed
+    std::vector<Chip8State> states(frames);
+    for(Chip8State& state : states)
+    {
+        chipEmu.runCycles(cyclesPerFrame);
+        chipEmu.tickTimers();
+        chipEmu.saveState(state);
+    }
+
+    Rewind history;
+    auto start = std::chrono::steady_clock::now();
+    for(const Chip8State& state : states)
+    {
+        history.push(state);
+    }
+    std::chrono::duration<double> pushTime = std::chrono::steady_clock::now() - start;
+    Rewind::Stats stats{history.getStats()};
+
+    Chip8State state;
+    unsigned int stepped{0};
+    start = std::chrono::steady_clock::now();
+    while(history.step(state))
+    {
+        stepped++;
+    }
+    std::chrono::duration<double> stepTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "    rewind: " << stats.frames << " frames in " << stats.bytesUsed / 1024 << " KB ("
+              << stats.bytesUsed / std::max<uint64_t>(stats.frames, 1) << " bytes/frame), push "
+              << pushTime.count() / frames * 1e9 << " ns, step " << stepTime.count() / std::max(stepped, 1u) * 1e9
+              << " ns\n";
+}
+
+static void benchBatch(const std::vector<uint8_t>& rom, unsigned int lanes, unsigned int frames)
+{
+    const char* kernelNames[] = { "scalar", "avx2" };
+
+    for(int kernel{0}; kernel <= (int)Chip8Batch::bestKernel(); kernel++)
+    {
+        Chip8Batch batch(lanes);
+        batch.setKernel((Chip8Batch::Kernel)kernel);
+        batch.loadROM(rom.data(), rom.size());
+
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned int frame{0}; frame < frames; frame++)
+        {
+            batch.runFrame();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        const Chip8Batch::Stats& stats{batch.getStats()};
+        std::cout << "    batch of " << lanes << " " << kernelNames[kernel] << ": "
+                  << stats.laneCycles / elapsed.count() / 1e6 << " MIPS, "
+                  << (double)stats.laneCycles / std::max<uint64_t>(stats.steps, 1) << " lanes per step, "
+                  << stats.singleSteps * 100 / std::max<uint64_t>(stats.steps, 1) << "% single lane steps\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int cyclesPerFrame{CLOCKHZ / DRAWHZ};
+    double totalSeconds{0};
+    uint64_t totalCycles{0};
+    Chip8::Engine engine{Chip8::Engine::Interpreter};
+    unsigned int frames{200000};
+    bool skipIdle{true};
+    bool timeState{false};
+    bool timeRewind{false};
+    unsigned int batchLanes{0};
+
+    for(int i{1}; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--present") == 0)
+        {
+            benchPresent();
+            continue;
+        }
+        if(strcmp(argv[i], "--blocks") == 0)
+        {
+            engine = Chip8::Engine::Blocks;
+            continue;
+        }
+        if(strcmp(argv[i], "--verify") == 0)
+        {
+            engine = Chip8::Engine::Verify;
+            continue;
+        }
+        if(strcmp(argv[i], "--switch") == 0)
+        {
+            engine = Chip8::Engine::Switch;
+            continue;
+        }
+        if(strcmp(argv[i], "--no-idle") == 0)
+        {
+            skipIdle = false;
+            continue;
+        }
+        if(strcmp(argv[i], "--state") == 0)
+        {
+            timeState = true;
+            continue;
+        }
+        if(strcmp(argv[i], "--rewind") == 0)
+        {
+            timeRewind = true;
+            continue;
+        }
+        if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batchLanes = std::stoul(argv[++i]);
+            continue;
+        }
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = std::stoul(argv[++i]);
+            continue;
+        }
+
+        std::vector<uint8_t> rom;
+        if(!readROM(argv[i], rom))
+        {
+            std::cout << "Could not read " << argv[i] << "\n";
+            return 1;
+        }
+        Chip8 chipEmu;
+        chipEmu.engine = engine;
+        chipEmu.skipIdle = skipIdle;
+        if(!chipEmu.loadROM(rom.data(), rom.size()))
+        {
+            std::cout << argv[i] << " will not fit in RAM\n";
+            return 1;
+        }
+
+        uint64_t cycles{0};
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned int frame{0}; frame < frames; frame++)
+        {
+            unsigned int frameCycles{0};
+            while(frameCycles < cyclesPerFrame)
+            {
+                // 0 after a trap, or while FX0A blocks with chargeKeyWait off
+                unsigned int used{chipEmu.runCycles(cyclesPerFrame - frameCycles)};
+                if(used == 0)
+                {
+                    break;
+                }
+                frameCycles += used;
+            }
+            cycles += frameCycles;
+            chipEmu.tickTimers();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << argv[i] << ": " << cycles / elapsed.count() / 1e6 << " MIPS\n";
+        if(chipEmu.idleCycles > 0)
+        {
+            std::cout << "    " << chipEmu.idleCycles * 100 / cycles << "% of cycles skipped as idle\n";
+        }
+        if(engine == Chip8::Engine::Verify)
+        {
+            std::cout << "    " << chipEmu.verifyMismatches << " block mismatches\n";
+            if(chipEmu.verifyMismatches > 0)
+            {
+                std::cout << "    last one ended at pc " << std::hex << chipEmu.verifyMismatchPc << std::dec << "\n";
+            }
+        }
+        if(chipEmu.trapped())
+        {
+            const Chip8::Trap& trap{chipEmu.getTrap()};
+            std::cout << "    trapped (" << Chip8::trapName(trap.kind) << ") at pc " << std::hex << trap.pc
+                      << std::dec << ", MIPS only count what ran before\n";
+        }
+        if(timeState)
+        {
+            benchState(chipEmu);
+        }
+        if(timeRewind)
+        {
+            benchRewind(chipEmu);
+        }
+        if(batchLanes > 0)
+        {
+            benchBatch(rom, batchLanes, std::max(frames / 10, 1u));
+        }
+
+        totalSeconds += elapsed.count();
+        totalCycles += cycles;
+    }
+
+    if(totalSeconds > 0)
+    {
+        std::cout << "total: " << totalCycles / totalSeconds / 1e6 << " MIPS\n";
+    }
+
+    return 0;
+}
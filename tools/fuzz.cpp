@@ -0,0 +1,124 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include "../src/Chip8.hpp"
+
+/*
+libFuzzer target for the interpreter core
+Every input is loaded as a ROM and run for FUZZ_FRAMES frames, keys changing
+from frame to frame so FX0A and the key skips get exercised too, once on
+the interpreter and once on the block engine. Then it runs twice more
+with budgets long enough for spin-wait loops to be fast-forwarded, idle
+skipping on and off. Built with ASan and UBSan any out of range access or
+undefined behaviour is a crash, and so is either pair ending in different
+states or, with STRICT=1, different traps.
+    make -f MakeFile fuzz
+    ./chip8-fuzz -max_len=3584 fuzz-corpus ROMs tools/fuzz-seeds
+ROMs/ and tools/fuzz-seeds/ (inputs that failed a check once) seed the
+corpus, new inputs go to fuzz-corpus. make -f MakeFile fuzz-replay builds
+the same target with gcc and a plain main that runs the files given, for
+crash files without clang and for rerunning the seeds:
+    ./chip8-fuzz-replay crash-*
+    find tools/fuzz-seeds -type f -exec ./chip8-fuzz-replay {} +
+*/
+
+#define FUZZ_FRAMES 120
+#define FUZZ_IDLE_BUDGET 1000 // instructions per step of the idle runs
+
+// a different pair of keys every few frames, with gaps for releases
+static uint16_t fuzzKeys(unsigned int frame)
+{
+    return frame % 4 == 3 ? 0 : 0x11 << (frame / 4 % 12);
+}
+
+static bool sameTrap(const Chip8::Trap& a, const Chip8::Trap& b)
+{
+    return a.kind == b.kind && a.pc == b.pc && a.opcode == b.opcode && a.address == b.address;
+}
+
+static uint64_t runEngine(Chip8& chip, Chip8::Engine engine, const uint8_t* data, size_t size)
+{
+    chip.reset();
+    chip.seedRandom(1);
+    chip.engine = engine;
+    chip.skipIdle = true;
+    chip.loadROM(data, size);
+
+    unsigned int cycleRemainder{0};
+    unsigned int timerRemainder{0};
+    for(unsigned int frame{0}; frame < FUZZ_FRAMES; frame++)
+    {
+        chip.setKeys(fuzzKeys(frame));
+        chip.runFrame(cycleRemainder, timerRemainder);
+    }
+    return chip.stateHash();
+}
+
+static uint64_t runIdle(Chip8& chip, bool skipIdle, const uint8_t* data, size_t size)
+{
+    chip.reset();
+    chip.seedRandom(1);
+    chip.engine = Chip8::Engine::Interpreter;
+    chip.skipIdle = skipIdle;
+    chip.loadROM(data, size);
+
+    for(unsigned int step{0}; step < FUZZ_FRAMES; step++)
+    {
+        chip.setKeys(fuzzKeys(step));
+        chip.runCycles(FUZZ_IDLE_BUDGET);
+        chip.tickTimers();
+    }
+    return chip.stateHash();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if(size > RAM_SIZE - RAM_START)
+    {
+        return 0;
+    }
+
+    // reused between inputs, reset() puts them back to power on
+    static Chip8 interpreter;
+    static Chip8 blocks;
+    if(runEngine(interpreter, Chip8::Engine::Interpreter, data, size)
+        != runEngine(blocks, Chip8::Engine::Blocks, data, size))
+    {
+        __builtin_trap();
+    }
+    if(!sameTrap(interpreter.getTrap(), blocks.getTrap()))
+    {
+        __builtin_trap();
+    }
+
+    // skipping an idle loop's laps may never change where the ROM ends up
+    if(runIdle(interpreter, true, data, size) != runIdle(blocks, false, data, size)
+        || !sameTrap(interpreter.getTrap(), blocks.getTrap()))
+    {
+        __builtin_trap();
+    }
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+int main(int argc, char* argv[])
+{
+    for(int i{1}; i < argc; i++)
+    {
+        FILE* file{fopen(argv[i], "rb")};
+        if(!file)
+        {
+            printf("Could not read %s\n", argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> data(RAM_SIZE);
+        size_t size{fread(data.data(), 1, data.size(), file)};
+        fclose(file);
+
+        printf("%s\n", argv[i]);
+        LLVMFuzzerTestOneInput(data.data(), size);
+    }
+    return 0;
+}
+#endif
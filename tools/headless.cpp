@@ -0,0 +1,226 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include "../src/Chip8.hpp"
+#include "../src/Scheduler.hpp"
+
+/*
+Headless runner, no SDL and no pacing
+Runs a ROM as fast as possible for a frame budget with no input, using
+the same Scheduler frames as the windowed build
+    chip8-headless rom.ch8 [options]
+        --frames N       frames to run (default 600, 10 seconds)
+        --cycles N       budget in cycles instead, rounded up to whole frames
+        --blocks         use the block engine
+        --verify         block engine checked against the interpreter
+        --no-idle        run spin-wait loops instead of skipping them
+        --seed N         seed for CXNN (default 0, as chip8-batch)
+        --replay file    keys (and seed) from a session recorded with
+                         Chip8 --record, runs to its end unless given a
+                         frame or cycle budget
+        --load-state f   start from a state saved with --save-state
+        --save-state f   write the final machine state
+        --dump file      write the final display as a PBM image
+        --hash           print a hash of the final machine state
+        --stats          print timing stats
+Built with STRICT=1 (the strict memory model) a ROM that reaches outside
+RAM or the stack stops, and the trap is printed with exit code 2
+*/
+
+static bool readROM(const char* fileName, std::vector<uint8_t>& rom)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    // more than fits in RAM, so a file too big still reads as too big
+    rom.resize(RAM_SIZE);
+    file.read(reinterpret_cast<char*>(rom.data()), rom.size());
+    rom.resize(file.gcount());
+    return !file.bad() && !rom.empty();
+}
+
+static bool dumpDisplay(const Chip8& chipEmu, const char* fileName)
+{
+    std::ofstream out(fileName);
+    if(!out.is_open())
+    {
+        return false;
+    }
+    out << "P1\n" << DISPLAY_COLUMNS << " " << DISPLAY_ROWS << "\n";
+    for(unsigned int row{0}; row < DISPLAY_ROWS; row++)
+    {
+        for(unsigned int col{0}; col < DISPLAY_COLUMNS; col++)
+        {
+            out << ((chipEmu.display[row] >> (63 - col)) & 0x1 ? '1' : '0');
+        }
+        out << "\n";
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::cout << "usage: chip8-headless rom.ch8 [--frames N | --cycles N] [--blocks | --verify]"
+                     " [--no-idle] [--seed N] [--replay file]"
+                     " [--load-state file] [--save-state file] [--dump file] [--hash] [--stats]\n";
+        return 1;
+    }
+
+    uint64_t totalFrames{0};
+    InputLog replay;
+    bool replaying{false};
+    uint32_t seed{0};
+    bool seeded{false};
+    const char* dumpFile{nullptr};
+    const char* loadFile{nullptr};
+    const char* saveFile{nullptr};
+    bool printHash{false};
+    bool printStats{false};
+
+    Chip8 chipEmu;
+    for(int i{2}; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            totalFrames = std::stoull(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+        {
+            totalFrames = (std::stoull(argv[++i]) * DRAWHZ + CLOCKHZ - 1) / CLOCKHZ;
+        }
+        else if(strcmp(argv[i], "--blocks") == 0)
+        {
+            chipEmu.engine = Chip8::Engine::Blocks;
+        }
+        else if(strcmp(argv[i], "--verify") == 0)
+        {
+            chipEmu.engine = Chip8::Engine::Verify;
+        }
+        else if(strcmp(argv[i], "--no-idle") == 0)
+        {
+            chipEmu.skipIdle = false;
+        }
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::stoul(argv[++i]);
+            seeded = true;
+        }
+        else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            if(!replay.load(argv[++i]))
+            {
+                std::cout << "Could not read " << argv[i] << "\n";
+                return 1;
+            }
+            replaying = true;
+        }
+        else if(strcmp(argv[i], "--load-state") == 0 && i + 1 < argc)
+        {
+            loadFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--save-state") == 0 && i + 1 < argc)
+        {
+            saveFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+        {
+            dumpFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--hash") == 0)
+        {
+            printHash = true;
+        }
+        else if(strcmp(argv[i], "--stats") == 0)
+        {
+            printStats = true;
+        }
+        else
+        {
+            std::cout << "Unknown option " << argv[i] << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> rom;
+    if(!readROM(argv[1], rom))
+    {
+        std::cout << "Could not read " << argv[1] << "\n";
+        return 1;
+    }
+    if(!chipEmu.loadROM(rom.data(), rom.size()))
+    {
+        std::cout << argv[1] << " will not fit in RAM\n";
+        return 1;
+    }
+    // a fixed seed, so --hash is the same from run to run
+    chipEmu.seedRandom(replaying && !seeded ? replay.seed : seed);
+    if(loadFile && !chipEmu.loadState(loadFile))
+    {
+        std::cout << "Could not load state from " << loadFile << "\n";
+        return 1;
+    }
+
+    Scheduler scheduler(chipEmu);
+    scheduler.setMode(Scheduler::Mode::FixedStep);
+    if(replaying)
+    {
+        scheduler.setReplay(&replay);
+    }
+    if(totalFrames == 0)
+    {
+        totalFrames = replaying ? (replay.endCycle * DRAWHZ + CLOCKHZ - 1) / CLOCKHZ : 600;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while(scheduler.getFrames() < totalFrames)
+    {
+        scheduler.advance();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if(saveFile && !chipEmu.saveState(saveFile))
+    {
+        std::cout << "Could not write " << saveFile << "\n";
+        return 1;
+    }
+    if(dumpFile && !dumpDisplay(chipEmu, dumpFile))
+    {
+        std::cout << "Could not write " << dumpFile << "\n";
+        return 1;
+    }
+    if(printHash)
+    {
+        std::cout << std::hex << chipEmu.stateHash() << std::dec << "\n";
+    }
+    if(printStats)
+    {
+        std::cout << "cycles: " << scheduler.getCycles() << "\n"
+                  << "idle cycles skipped: " << chipEmu.idleCycles << "\n"
+                  << "frames: " << scheduler.getFrames() << "\n"
+                  << "seconds: " << elapsed.count() << "\n"
+                  << "MIPS: " << scheduler.getCycles() / elapsed.count() / 1e6 << "\n"
+                  << "speed: " << scheduler.virtualTimeNs() / 1e9 / elapsed.count() << "x real time\n";
+        if(chipEmu.engine == Chip8::Engine::Verify)
+        {
+            std::cout << "block mismatches: " << chipEmu.verifyMismatches << "\n";
+            if(chipEmu.verifyMismatches > 0)
+            {
+                std::cout << "last mismatch at pc: " << std::hex << chipEmu.verifyMismatchPc << std::dec << "\n";
+            }
+        }
+    }
+    if(chipEmu.trapped())
+    {
+        const Chip8::Trap& trap{chipEmu.getTrap()};
+        std::cout << "trap: " << Chip8::trapName(trap.kind) << std::hex << " at pc " << trap.pc
+                  << ", opcode " << trap.opcode << ", address " << trap.address << std::dec << "\n";
+        return 2;
+    }
+
+    return 0;
+}